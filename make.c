@@ -24,7 +24,7 @@
 	} while (false)
 
 static void cc(void *);
-static void ld(void);
+static void ld(const char *, const char *);
 static char *mkoutpath(const char *);
 static char *xstrdup(const char *);
 static void *xmalloc(size_t);
@@ -42,6 +42,7 @@ static const char *warnings[] = {
 
 static const char *cflags_all[] = {
 	"-std=c11",
+	"-pthread",
 #if __GLIBC__
 	"-D_GNU_SOURCE",
 #endif
@@ -70,7 +71,7 @@ usage(void)
 {
 	fprintf(stderr,
 	        "Usage: %s [-p generic|arm64|x64] [-o outfile] [-fSr]\n"
-	        "       %s clean | install\n",
+	        "       %s clean | install | test\n",
 	        argv0, argv0);
 	exit(EXIT_FAILURE);
 }
@@ -133,17 +134,19 @@ main(int argc, char **argv)
 			cmd_append(&cmd, "find", ".",
 				"(",
 					"-name", "totp",
+					"-or", "-name", "totpd",
 					"-or", "-name", "totp-*",
 					"-or", "-name", "*.o",
 				")", "-delete"
 			);
 			CMDPRC(cmd);
 		} else if (streq(argv[0], "install")) {
-			char *bin, *man;
+			char *bin, *man, *man8;
 			bin = mkoutpath("/bin");
 			man = mkoutpath("/share/man/man1");
+			man8 = mkoutpath("/share/man/man8");
 
-			cmd_append(&cmd, "mkdir", "-p", bin, man);
+			cmd_append(&cmd, "mkdir", "-p", bin, man, man8);
 			CMDPRC(cmd);
 
 			const char *stripprg = binexists("strip") ? "strip"
@@ -152,15 +155,29 @@ main(int argc, char **argv)
 			if (stripprg != NULL) {
 				cmd_append(&cmd, stripprg, "--strip-all", "totp");
 				CMDPRC(cmd);
+#if __linux__
+				cmd_append(&cmd, stripprg, "--strip-all", "totpd");
+				CMDPRC(cmd);
+#endif
 			}
 
 			cmd_append(&cmd, "cp", "totp", bin);
 			CMDPRC(cmd);
 			cmd_append(&cmd, "cp", "totp.1", man);
 			CMDPRC(cmd);
+#if __linux__
+			cmd_append(&cmd, "cp", "totpd", bin);
+			CMDPRC(cmd);
+			cmd_append(&cmd, "cp", "totpd.8", man8);
+			CMDPRC(cmd);
+#endif
 
 			free(bin);
 			free(man);
+			free(man8);
+		} else if (streq(argv[0], "test")) {
+			cmd_append(&cmd, "sh", "test.sh");
+			CMDPRC(cmd);
 		} else {
 			fprintf(stderr, "%s: invalid subcommand -- '%s'\n", argv0, *argv);
 			usage();
@@ -183,12 +200,22 @@ main(int argc, char **argv)
 		{
 			continue;
 		}
+#if !__linux__
+		/* The daemon is built on epoll */
+		if (streq(g.gl_pathv[i], "src/totpd.c"))
+			continue;
+#endif
 		cc(g.gl_pathv[i]);
 	}
 
 	free(ext);
 	globfree(&g);
-	ld();
+
+	/* Both programs share every object but their own main() */
+	ld(oflag, "src/totpd.o");
+#if __linux__
+	ld("totpd", "src/main.o");
+#endif
 
 	return EXIT_SUCCESS;
 }
@@ -232,8 +259,9 @@ out:
 	free(dst);
 }
 
+/* Link every object except SKIP into OUT */
 void
-ld(void)
+ld(const char *out, const char *skip)
 {
 	glob_t g;
 	bool dobuild = fflag;
@@ -256,7 +284,7 @@ ld(void)
 	if (!Sflag)
 		cmd_append(&cmd, "-fsanitize=address,undefined");
 
-	cmd_append(&cmd, "-o", oflag);
+	cmd_append(&cmd, "-o", out);
 
 	assert(glob("src/*.o", 0, NULL, &g) == 0);
 
@@ -269,7 +297,9 @@ ld(void)
 		{
 			continue;
 		}
-		if (needs_rebuild1(oflag, g.gl_pathv[i]))
+		if (streq(g.gl_pathv[i], skip))
+			continue;
+		if (needs_rebuild1(out, g.gl_pathv[i]))
 			dobuild = true;
 
 		cmd_append(&cmd, g.gl_pathv[i]);
@@ -0,0 +1,175 @@
+#include <sys/mman.h>
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acctab.h"
+#include "common.h"
+
+/* Accounts allocated for on the first addition */
+#define CAPMIN (256)
+
+/* The huge page size we round to; larger ones are never asked for */
+#define HUGESZ ((size_t)2 << 20)
+
+/* The label offset of an account without a label */
+#define NOLABEL SIZE_MAX
+
+static void grow(acctab_t *);
+static void *hotalloc(size_t, bool);
+static void hotfree(void *, size_t, bool);
+static inline size_t hotsize(size_t, bool)
+	__attribute__((always_inline, const));
+
+void
+acctab_init(acctab_t *t, bool huge)
+{
+	memset(t, 0, sizeof(*t));
+	t->huge = huge;
+}
+
+/* Add the account with the midstates KEY, DIGITS, and PERIOD to T,
+   labelled with the LABELSZ bytes at LABEL unless LABEL is NULL.
+   Returns the account’s index. */
+size_t
+acctab_add(acctab_t *t, const hmac_sha1_key_t *key, int digits, int period,
+           const char *label, size_t labelsz)
+{
+	if (t->n == t->cap)
+		grow(t);
+
+	size_t i = t->n++;
+	t->keys[i] = *key;
+	t->digits[i] = (uint8_t)digits;
+	t->periods[i] = (uint32_t)period;
+
+	if (label == NULL) {
+		if (t->labels != NULL)
+			t->labels[i] = NOLABEL;
+		return i;
+	}
+
+	if (t->labels == NULL) {
+		if ((t->labels = malloc(t->cap * sizeof(*t->labels))) == NULL)
+			err(1, "malloc");
+		for (size_t j = 0; j < i; j++)
+			t->labels[j] = NOLABEL;
+	}
+	if (t->arenacap - t->arenasz <= labelsz) {
+		do
+			t->arenacap = t->arenacap ? t->arenacap * 2 : 4096;
+		while (t->arenacap - t->arenasz <= labelsz);
+		if ((t->arena = realloc(t->arena, t->arenacap)) == NULL)
+			err(1, "realloc");
+	}
+	memcpy(t->arena + t->arenasz, label, labelsz);
+	t->arena[t->arenasz + labelsz] = 0;
+	t->labels[i] = t->arenasz;
+	t->arenasz += labelsz + 1;
+	return i;
+}
+
+/* Copy account I of T into A */
+void
+acctab_get(const acctab_t *t, size_t i, account_t *a)
+{
+	a->key = t->keys[i];
+	a->digits = t->digits[i];
+	a->period = (int)t->periods[i];
+}
+
+/* The label of account I of T, or NULL if it has none.  The pointer is
+   invalidated by the next call to acctab_add(). */
+const char *
+acctab_label(const acctab_t *t, size_t i)
+{
+	if (t->labels == NULL || t->labels[i] == NOLABEL)
+		return NULL;
+	return t->arena + t->labels[i];
+}
+
+void
+acctab_free(acctab_t *t)
+{
+	hotfree(t->keys, t->cap * sizeof(*t->keys), t->huge);
+	hotfree(t->periods, t->cap * sizeof(*t->periods), t->huge);
+	hotfree(t->digits, t->cap * sizeof(*t->digits), t->huge);
+	free(t->labels);
+	free(t->arena);
+	memset(t, 0, sizeof(*t));
+}
+
+/* Double the capacity of T.  The hot arrays are moved into fresh
+   mappings rather than realloc()ed so that they stay page-aligned and
+   can be backed by huge pages. */
+void
+grow(acctab_t *t)
+{
+	size_t cap = t->cap != 0 ? t->cap * 2 : CAPMIN;
+
+	hmac_sha1_key_t *keys = hotalloc(cap * sizeof(*keys), t->huge);
+	uint32_t *periods = hotalloc(cap * sizeof(*periods), t->huge);
+	uint8_t *digits = hotalloc(cap * sizeof(*digits), t->huge);
+	if (t->n != 0) {
+		memcpy(keys, t->keys, t->n * sizeof(*keys));
+		memcpy(periods, t->periods, t->n * sizeof(*periods));
+		memcpy(digits, t->digits, t->n * sizeof(*digits));
+	}
+	hotfree(t->keys, t->cap * sizeof(*t->keys), t->huge);
+	hotfree(t->periods, t->cap * sizeof(*t->periods), t->huge);
+	hotfree(t->digits, t->cap * sizeof(*t->digits), t->huge);
+
+	t->keys = keys;
+	t->periods = periods;
+	t->digits = digits;
+	if (t->labels != NULL
+	 && (t->labels = realloc(t->labels, cap * sizeof(*t->labels))) == NULL)
+	{
+		err(1, "realloc");
+	}
+	t->cap = cap;
+}
+
+/* Map SZ bytes of zeroed memory.  With HUGE, explicit huge pages are
+   tried first; if none are reserved we fall back to normal pages and
+   ask for them to be made transparent huge pages instead. */
+void *
+hotalloc(size_t sz, bool huge)
+{
+	void *p;
+	sz = hotsize(sz, huge);
+
+#ifdef MAP_HUGETLB
+	if (huge) {
+		p = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+		         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+			return p;
+	}
+#endif
+
+	p = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+	         -1, 0);
+	if (p == MAP_FAILED)
+		err(1, "mmap");
+#ifdef MADV_HUGEPAGE
+	if (huge)
+		(void)madvise(p, sz, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+void
+hotfree(void *p, size_t sz, bool huge)
+{
+	if (p != NULL)
+		munmap(p, hotsize(sz, huge));
+}
+
+/* Mappings of huge pages must be a whole number of them */
+size_t
+hotsize(size_t sz, bool huge)
+{
+	return huge ? (sz + HUGESZ - 1) & ~(HUGESZ - 1) : sz;
+}
@@ -0,0 +1,43 @@
+#ifndef TOTP_ACCTAB_H
+#define TOTP_ACCTAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hmac.h"
+#include "totp.h"
+
+/* A table of accounts stored as a structure of arrays.  Sweeping over
+   every account to generate its code touches only KEYS, DIGITS, and
+   PERIODS, each its own cache-line-aligned array, so nothing else is
+   dragged through the cache.  Labels are cold and kept NUL-terminated
+   in a single arena, addressed by their offsets in LABELS.
+
+   With HUGE the hot arrays are backed by huge pages where the system
+   has them, either explicitly (MAP_HUGETLB) or by asking for
+   transparent huge pages, which cuts TLB misses when sweeping over
+   millions of accounts. */
+typedef struct {
+	hmac_sha1_key_t *keys;
+	uint32_t *periods;
+	uint8_t *digits;
+	size_t n, cap;
+
+	/* Offsets into ARENA, or NULL if no account has a label */
+	size_t *labels;
+	char *arena;
+	size_t arenasz, arenacap;
+
+	bool huge;
+} acctab_t;
+
+void acctab_init(acctab_t *, bool);
+size_t acctab_add(acctab_t *, const hmac_sha1_key_t *, int, int,
+                  const char *, size_t);
+void acctab_get(const acctab_t *, size_t, account_t *);
+const char *acctab_label(const acctab_t *, size_t)
+	__attribute__((pure));
+void acctab_free(acctab_t *);
+
+#endif /* !TOTP_ACCTAB_H */
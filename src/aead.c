@@ -0,0 +1,104 @@
+#include <string.h>
+
+#include "aead.h"
+#include "xendian.h"
+
+/* Keystream blocks generated at a time */
+#define KSBLKS (8)
+
+static void stream(uint8_t *restrict, uint8_t [restrict static POLY1305KEYSZ],
+                  const uint8_t [restrict static AEADKEYSZ],
+                  const uint8_t [restrict static AEADNONCESZ],
+                  const uint8_t *restrict, size_t);
+static void mac(uint8_t [static AEADTAGSZ],
+                const uint8_t [static POLY1305KEYSZ],
+                const uint8_t *, size_t, const uint8_t *, size_t);
+
+/* Encrypt the N bytes at PT into CT with the ChaCha20-Poly1305 AEAD of
+   RFC 8439 section 2.8, authenticating them along with the AADSZ bytes
+   at AAD.  The tag is written to TAG. */
+void
+aead_seal(uint8_t *restrict ct, uint8_t tag[restrict static AEADTAGSZ],
+          const uint8_t key[restrict static AEADKEYSZ],
+          const uint8_t nonce[restrict static AEADNONCESZ],
+          const uint8_t *restrict aad, size_t aadsz,
+          const uint8_t *restrict pt, size_t n)
+{
+	uint8_t otk[POLY1305KEYSZ];
+	stream(ct, otk, key, nonce, pt, n);
+	mac(tag, otk, aad, aadsz, ct, n);
+	memset(otk, 0, sizeof(otk));
+}
+
+/* The inverse of aead_seal().  If TAG doesn’t match then PT is zeroed
+   and false is returned. */
+bool
+aead_open(uint8_t *restrict pt, const uint8_t key[restrict static AEADKEYSZ],
+          const uint8_t nonce[restrict static AEADNONCESZ],
+          const uint8_t *restrict aad, size_t aadsz,
+          const uint8_t *restrict ct, size_t n,
+          const uint8_t tag[restrict static AEADTAGSZ])
+{
+	uint8_t otk[POLY1305KEYSZ], want[AEADTAGSZ];
+	stream(pt, otk, key, nonce, ct, n);
+	mac(want, otk, aad, aadsz, ct, n);
+	memset(otk, 0, sizeof(otk));
+
+	uint8_t diff = 0;
+	for (size_t i = 0; i < AEADTAGSZ; i++)
+		diff |= want[i] ^ tag[i];
+	if (diff != 0) {
+		memset(pt, 0, n);
+		return false;
+	}
+	return true;
+}
+
+/* XOR the N bytes at SRC into DST with the keystream from block 1 on,
+   and write the Poly1305 key taken from block 0 to OTK */
+void
+stream(uint8_t *restrict dst, uint8_t otk[restrict static POLY1305KEYSZ],
+      const uint8_t key[restrict static AEADKEYSZ],
+      const uint8_t nonce[restrict static AEADNONCESZ],
+      const uint8_t *restrict src, size_t n)
+{
+	uint8_t ks[KSBLKS * CHACHABLKSZ];
+	size_t nblks = 1 + (n + CHACHABLKSZ - 1) / CHACHABLKSZ;
+	uint32_t ctr = 0;
+
+	size_t m = nblks < KSBLKS ? nblks : KSBLKS;
+	chacha20(ks, key, nonce, ctr, m);
+	memcpy(otk, ks, POLY1305KEYSZ);
+
+	size_t off = CHACHABLKSZ, end = m * CHACHABLKSZ;
+	for (size_t i = 0; i < n; i++) {
+		if (off == end) {
+			ctr += KSBLKS;
+			nblks -= KSBLKS;
+			m = nblks < KSBLKS ? nblks : KSBLKS;
+			chacha20(ks, key, nonce, ctr, m);
+			off = 0;
+			end = m * CHACHABLKSZ;
+		}
+		dst[i] = src[i] ^ ks[off++];
+	}
+
+	memset(ks, 0, sizeof(ks));
+}
+
+void
+mac(uint8_t tag[static AEADTAGSZ], const uint8_t otk[static POLY1305KEYSZ],
+    const uint8_t *aad, size_t aadsz, const uint8_t *ct, size_t n)
+{
+	static const uint8_t zeros[15];
+	poly1305_t p;
+	uint64_t lens[2] = {htole64((uint64_t)aadsz), htole64((uint64_t)n)};
+
+	poly1305init(&p, otk);
+	poly1305hash(&p, aad, aadsz);
+	poly1305hash(&p, zeros, -aadsz & 15);
+	poly1305hash(&p, ct, n);
+	poly1305hash(&p, zeros, -n & 15);
+	poly1305hash(&p, (uint8_t *)lens, sizeof(lens));
+	poly1305end(&p, tag);
+}
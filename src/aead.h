@@ -0,0 +1,26 @@
+#ifndef TOTP_AEAD_H
+#define TOTP_AEAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chacha.h"
+#include "poly1305.h"
+
+#define AEADKEYSZ   CHACHAKEYSZ
+#define AEADNONCESZ CHACHANONCESZ
+#define AEADTAGSZ   POLY1305TAGSZ
+
+void aead_seal(uint8_t *restrict, uint8_t [restrict static AEADTAGSZ],
+               const uint8_t [restrict static AEADKEYSZ],
+               const uint8_t [restrict static AEADNONCESZ],
+               const uint8_t *restrict, size_t,
+               const uint8_t *restrict, size_t);
+bool aead_open(uint8_t *restrict, const uint8_t [restrict static AEADKEYSZ],
+               const uint8_t [restrict static AEADNONCESZ],
+               const uint8_t *restrict, size_t,
+               const uint8_t *restrict, size_t,
+               const uint8_t [restrict static AEADTAGSZ]);
+
+#endif /* !TOTP_AEAD_H */
@@ -0,0 +1,86 @@
+#include <arm_neon.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/* Base32 decoding 16 characters at a time.  See base32-x64.c; lacking
+   pmaddubsw and pmaddwd the pairwise joins are done with shifts of the
+   16- and 32-bit lanes instead. */
+
+size_t
+b32blks(uint8_t *restrict dst, const char *restrict src, size_t len)
+{
+	static const uint8_t shuf[] = {
+		4, 3, 2, 1, 0, 12, 11, 10, 9, 8, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	};
+	const uint8x16_t tbl = vld1q_u8(shuf);
+
+	size_t i, j;
+	for (i = j = 0; len - i >= 16; i += 16, j += 10) {
+		uint8x16_t c = vld1q_u8((const uint8_t *)src + i);
+		uint8x16_t alpha = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')),
+		                            vcleq_u8(c, vdupq_n_u8('Z')));
+		uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('2')),
+		                            vcleq_u8(c, vdupq_n_u8('7')));
+		if (vminvq_u8(vorrq_u8(alpha, digit)) == 0)
+			break;
+
+		uint8x16_t off = vbslq_u8(alpha, vdupq_n_u8('A'),
+		                          vdupq_n_u8('2' - 26));
+		uint8x16_t v = vsubq_u8(c, off);
+
+		/* v0<<5 | v1 in each 16-bit lane */
+		uint16x8_t h = vreinterpretq_u16_u8(v);
+		h = vorrq_u16(vshlq_n_u16(vandq_u16(h, vdupq_n_u16(0xFF)), 5),
+		              vshrq_n_u16(h, 8));
+
+		/* x0<<10 | x1 in each 32-bit lane */
+		uint32x4_t w = vreinterpretq_u32_u16(h);
+		w = vorrq_u32(vshlq_n_u32(vandq_u32(w, vdupq_n_u32(0xFFFF)), 10),
+		              vshrq_n_u32(w, 16));
+
+		/* A<<20 | B in each 64-bit lane */
+		uint64x2_t d = vreinterpretq_u64_u32(w);
+		d = vorrq_u64(vandq_u64(vshlq_n_u64(d, 20),
+		                        vdupq_n_u64(0xFFFFFFFFFFULL)),
+		              vshrq_n_u64(d, 32));
+
+		uint8x16_t out = vqtbl1q_u8(vreinterpretq_u8_u64(d), tbl);
+		vst1_u8(dst + j, vget_low_u8(out));
+		vst1q_lane_u16((uint16_t *)(dst + j + 8), vreinterpretq_u16_u8(out), 4);
+	}
+
+	return i;
+}
+
+/* Base32 encoding 10 bytes at a time.  See base32-x64.c; the per-lane
+   shifts are done by vshlq_u16() directly rather than multiplies. */
+size_t
+b32encblks(char *restrict dst, const uint8_t *restrict src, size_t n)
+{
+	static const uint8_t shuf[] = {
+		1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4,
+		6, 5, 6, 5, 7, 6, 7, 6, 8, 7, 9, 8, 9, 8, 10, 9,
+	};
+	static const int16_t shift[] = {-11, -6, -9, -4, -7, -10, -5, -8};
+	const uint8x16_t lotbl = vld1q_u8(shuf), hitbl = vld1q_u8(shuf + 16);
+	const int16x8_t sh = vld1q_s16(shift);
+
+	size_t i, j;
+	for (i = j = 0; n - i >= 16; i += 10, j += 16) {
+		uint8x16_t b = vld1q_u8(src + i);
+		uint16x8_t lo = vreinterpretq_u16_u8(vqtbl1q_u8(b, lotbl)),
+		           hi = vreinterpretq_u16_u8(vqtbl1q_u8(b, hitbl));
+		lo = vandq_u16(vshlq_u16(lo, sh), vdupq_n_u16(0x1F));
+		hi = vandq_u16(vshlq_u16(hi, sh), vdupq_n_u16(0x1F));
+
+		uint8x16_t v = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+		uint8x16_t digit = vcgtq_u8(v, vdupq_n_u8(25));
+		v = vsubq_u8(vaddq_u8(v, vdupq_n_u8('A')),
+		             vandq_u8(digit, vdupq_n_u8('A' - '2' + 26)));
+		vst1q_u8((uint8_t *)dst + j, v);
+	}
+
+	return i;
+}
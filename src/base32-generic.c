@@ -0,0 +1,58 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+extern const char b32alphabet[32];
+extern const uint8_t b32lookup[256];
+
+size_t
+b32blks(uint8_t *restrict dst, const char *restrict src, size_t len)
+{
+	size_t i, j;
+	for (i = j = 0; len - i >= 8; i += 8, j += 5) {
+		uint8_t v[] = {
+			b32lookup[(uint8_t)src[i + 0]],
+			b32lookup[(uint8_t)src[i + 1]],
+			b32lookup[(uint8_t)src[i + 2]],
+			b32lookup[(uint8_t)src[i + 3]],
+			b32lookup[(uint8_t)src[i + 4]],
+			b32lookup[(uint8_t)src[i + 5]],
+			b32lookup[(uint8_t)src[i + 6]],
+			b32lookup[(uint8_t)src[i + 7]],
+		};
+
+		/* Valid values are all below 32, so any invalid character
+		   shows up in the OR of the block */
+		uint8_t or = v[0] | v[1] | v[2] | v[3] | v[4] | v[5] | v[6] | v[7];
+		if (or == 0xFF)
+			break;
+
+		dst[j + 0] = (uint8_t)(v[0]<<3 | v[1]>>2);
+		dst[j + 1] = (uint8_t)(v[1]<<6 | v[2]<<1 | v[3]>>4);
+		dst[j + 2] = (uint8_t)(v[3]<<4 | v[4]>>1);
+		dst[j + 3] = (uint8_t)(v[4]<<7 | v[5]<<2 | v[6]>>3);
+		dst[j + 4] = (uint8_t)(v[6]<<5 | v[7]>>0);
+	}
+	return i;
+}
+
+size_t
+b32encblks(char *restrict dst, const uint8_t *restrict src, size_t n)
+{
+	size_t i, j;
+	for (i = j = 0; n - i >= 5; i += 5, j += 8) {
+		uint64_t x = (uint64_t)src[i + 0] << 32 | (uint64_t)src[i + 1] << 24
+		           | (uint64_t)src[i + 2] << 16 | (uint64_t)src[i + 3] <<  8
+		           | (uint64_t)src[i + 4] <<  0;
+		dst[j + 0] = b32alphabet[x >> 35 & 0x1F];
+		dst[j + 1] = b32alphabet[x >> 30 & 0x1F];
+		dst[j + 2] = b32alphabet[x >> 25 & 0x1F];
+		dst[j + 3] = b32alphabet[x >> 20 & 0x1F];
+		dst[j + 4] = b32alphabet[x >> 15 & 0x1F];
+		dst[j + 5] = b32alphabet[x >> 10 & 0x1F];
+		dst[j + 6] = b32alphabet[x >>  5 & 0x1F];
+		dst[j + 7] = b32alphabet[x >>  0 & 0x1F];
+	}
+	return i;
+}
@@ -0,0 +1,181 @@
+#include <immintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+/* Base32 decoding 16 or 32 characters at a time.
+
+   Characters are validated with range compares and mapped to their 5-bit
+   values by subtracting 'A' from letters and '2' - 26 from digits.  The
+   values are then packed pairwise: maddubs joins pairs of 5-bit values
+   into 10-bit ones, madd joins pairs of those into 20-bit ones, and a
+   64-bit shift joins pairs of those into the 40 bits of an 8-character
+   block.  A final shuffle puts the 5 bytes of each block in big-endian
+   order. */
+
+/* Base32 encoding 10 or 20 bytes at a time.
+
+   Each of the 8 values of a 5-byte block lies within some big-endian
+   16-bit window of the block, so a shuffle gives every value a 16-bit
+   lane of its own.  Multiplying by a per-lane power of two shifts the
+   value to the top of its lane, from where one shift brings it down to
+   the bottom.  Values become characters by adding 'A', less 'A' - '2' +
+   26 for the digits. */
+
+static inline __m128i decode16(__m128i, int *)
+	__attribute__((always_inline));
+static inline __m128i encode16(__m128i)
+	__attribute__((always_inline));
+
+size_t
+b32blks(uint8_t *restrict dst, const char *restrict src, size_t len)
+{
+	size_t i = 0, j = 0;
+
+#ifdef __AVX2__
+	const __m256i A  = _mm256_set1_epi8('A' - 1);
+	const __m256i Z  = _mm256_set1_epi8('Z' + 1);
+	const __m256i D0 = _mm256_set1_epi8('2' - 1);
+	const __m256i D7 = _mm256_set1_epi8('7' + 1);
+	const __m256i OA = _mm256_set1_epi8('A');
+	const __m256i OD = _mm256_set1_epi8('2' - 26);
+	const __m256i M1 = _mm256_set1_epi16(0x0120);
+	const __m256i M2 = _mm256_set1_epi32(0x00010400);
+	const __m256i M40 = _mm256_set1_epi64x(0xFFFFFFFFFFLL);
+	const __m256i SHUF = _mm256_setr_epi8(
+		4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1,
+		4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1
+	);
+
+	for (; len - i >= 32; i += 32, j += 20) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(c, A),
+		                                 _mm256_cmpgt_epi8(Z, c));
+		__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, D0),
+		                                 _mm256_cmpgt_epi8(D7, c));
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(alpha, digit))
+		    != UINT32_MAX)
+		{
+			break;
+		}
+
+		__m256i off = _mm256_or_si256(_mm256_and_si256(alpha, OA),
+		                              _mm256_and_si256(digit, OD));
+		__m256i v = _mm256_sub_epi8(c, off);
+		v = _mm256_maddubs_epi16(v, M1);
+		v = _mm256_madd_epi16(v, M2);
+		v = _mm256_or_si256(
+			_mm256_and_si256(_mm256_slli_epi64(v, 20), M40),
+			_mm256_srli_epi64(v, 32));
+		v = _mm256_shuffle_epi8(v, SHUF);
+
+		__m128i lo = _mm256_castsi256_si128(v);
+		__m128i hi = _mm256_extracti128_si256(v, 1);
+		uint16_t t;
+		_mm_storel_epi64((__m128i *)(dst + j), lo);
+		t = (uint16_t)_mm_extract_epi16(lo, 4);
+		memcpy(dst + j + 8, &t, sizeof(t));
+		_mm_storel_epi64((__m128i *)(dst + j + 10), hi);
+		t = (uint16_t)_mm_extract_epi16(hi, 4);
+		memcpy(dst + j + 18, &t, sizeof(t));
+	}
+#endif
+
+	for (; len - i >= 16; i += 16, j += 10) {
+		int ok;
+		__m128i v = decode16(_mm_loadu_si128((const __m128i *)(src + i)), &ok);
+		if (!ok)
+			break;
+
+		_mm_storel_epi64((__m128i *)(dst + j), v);
+		uint16_t t = (uint16_t)_mm_extract_epi16(v, 4);
+		memcpy(dst + j + 8, &t, sizeof(t));
+	}
+
+	return i;
+}
+
+/* Decode the 16 characters C into the first 10 bytes of the result,
+   setting OK to whether they were all valid */
+__m128i
+decode16(__m128i c, int *ok)
+{
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+	                              _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('2' - 1)),
+	                              _mm_cmplt_epi8(c, _mm_set1_epi8('7' + 1)));
+	*ok = _mm_movemask_epi8(_mm_or_si128(alpha, digit)) == 0xFFFF;
+
+	__m128i off = _mm_or_si128(_mm_and_si128(alpha, _mm_set1_epi8('A')),
+	                           _mm_and_si128(digit, _mm_set1_epi8('2' - 26)));
+	__m128i v = _mm_sub_epi8(c, off);
+	v = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0120));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00010400));
+	v = _mm_or_si128(
+		_mm_and_si128(_mm_slli_epi64(v, 20), _mm_set1_epi64x(0xFFFFFFFFFFLL)),
+		_mm_srli_epi64(v, 32));
+	return _mm_shuffle_epi8(v, _mm_setr_epi8(
+		4, 3, 2, 1, 0, 12, 11, 10, 9, 8, -1, -1, -1, -1, -1, -1));
+}
+
+/* The shuffles and multipliers of encode16() for the first and second
+   blocks of a vector */
+#define ENCLO 1, 0, 1, 0, 2, 1, 2, 1, 3, 2, 4, 3, 4, 3, 5, 4
+#define ENCHI 6, 5, 6, 5, 7, 6, 7, 6, 8, 7, 9, 8, 9, 8, 10, 9
+#define ENCMUL 1<<0, 1<<5, 1<<2, 1<<7, 1<<4, 1<<1, 1<<6, 1<<3
+
+size_t
+b32encblks(char *restrict dst, const uint8_t *restrict src, size_t n)
+{
+	size_t i = 0, j = 0;
+
+#ifdef __AVX2__
+	const __m256i LO  = _mm256_setr_epi8(ENCLO, ENCLO);
+	const __m256i HI  = _mm256_setr_epi8(ENCHI, ENCHI);
+	const __m256i MUL = _mm256_setr_epi16(ENCMUL, ENCMUL);
+	const __m256i V25 = _mm256_set1_epi8(25);
+	const __m256i OA  = _mm256_set1_epi8('A');
+	const __m256i OD  = _mm256_set1_epi8('A' - '2' + 26);
+
+	/* Each lane loads 16 bytes to encode 10 */
+	for (; n - i >= 26; i += 20, j += 32) {
+		__m256i b = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(
+				_mm_loadu_si128((const __m128i *)(src + i))),
+			_mm_loadu_si128((const __m128i *)(src + i + 10)), 1);
+		__m256i lo = _mm256_shuffle_epi8(b, LO),
+		        hi = _mm256_shuffle_epi8(b, HI);
+		lo = _mm256_srli_epi16(_mm256_mullo_epi16(lo, MUL), 11);
+		hi = _mm256_srli_epi16(_mm256_mullo_epi16(hi, MUL), 11);
+		__m256i v = _mm256_packus_epi16(lo, hi);
+		__m256i digit = _mm256_cmpgt_epi8(v, V25);
+		v = _mm256_add_epi8(v, _mm256_sub_epi8(OA,
+			_mm256_and_si256(digit, OD)));
+		_mm256_storeu_si256((__m256i *)(dst + j), v);
+	}
+#endif
+
+	for (; n - i >= 16; i += 10, j += 16) {
+		__m128i v = encode16(_mm_loadu_si128((const __m128i *)(src + i)));
+		_mm_storeu_si128((__m128i *)(dst + j), v);
+	}
+
+	return i;
+}
+
+/* Encode the first 10 bytes of B into 16 characters */
+__m128i
+encode16(__m128i b)
+{
+	const __m128i MUL = _mm_setr_epi16(ENCMUL);
+	__m128i lo = _mm_shuffle_epi8(b, _mm_setr_epi8(ENCLO)),
+	        hi = _mm_shuffle_epi8(b, _mm_setr_epi8(ENCHI));
+	lo = _mm_srli_epi16(_mm_mullo_epi16(lo, MUL), 11);
+	hi = _mm_srli_epi16(_mm_mullo_epi16(hi, MUL), 11);
+	__m128i v = _mm_packus_epi16(lo, hi);
+	__m128i digit = _mm_cmpgt_epi8(v, _mm_set1_epi8(25));
+	return _mm_add_epi8(v, _mm_sub_epi8(_mm_set1_epi8('A'),
+		_mm_and_si128(digit, _mm_set1_epi8('A' - '2' + 26))));
+}
@@ -1,12 +1,15 @@
 #include <assert.h>
+#include <string.h>
 
 #include "base32.h"
 #include "common.h"
 
-static inline bool b32blktoa(uint8_t *restrict, const uint8_t *restrict)
-	__attribute__((always_inline));
+size_t b32blks(uint8_t *restrict, const char *restrict, size_t);
+size_t b32encblks(char *restrict, const uint8_t *restrict, size_t);
 
-static const uint8_t lookup[] = {
+const char b32alphabet[32] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+const uint8_t b32lookup[256] = {
 	/* [00…07] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 	/* [08…0F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 	/* [10…17] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
@@ -18,7 +21,7 @@ static const uint8_t lookup[] = {
 	/* [40…47] = */ 0xFF,    0,    1,    2,    3,    4,    5,    6,
 	/* [48…4F] = */    7,    8,    9,   10,   11,   12,   13,   14,
 	/* [50…57] = */   15,   16,   17,   18,   19,   20,   21,   22,
-	/* [58…5F] = */   23,   24,  25,  0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [58…5F] = */   23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 	/* [60…67] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 	/* [68…6F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 	/* [70…77] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
@@ -41,53 +44,195 @@ static const uint8_t lookup[] = {
 	/* [F8…FF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
 };
 
-bool
+/* Like b32lookup, but lowercase letters decode like uppercase ones,
+   whitespace and hyphens are skipped, and ‘=’ is padding */
+#define LAXSKIP (0xFE)
+#define LAXPAD  (0xFD)
+
+static const uint8_t b32lax[256] = {
+	/* [00…07] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [08…0F] = */ 0xFF, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [10…17] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [18…1F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [20…27] = */ 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [28…2F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE, 0xFF, 0xFF,
+	/* [30…37] = */ 0xFF, 0xFF,   26,   27,   28,   29,   30,   31,
+	/* [38…3F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFD, 0xFF, 0xFF,
+	/* [40…47] = */ 0xFF,    0,    1,    2,    3,    4,    5,    6,
+	/* [48…4F] = */    7,    8,    9,   10,   11,   12,   13,   14,
+	/* [50…57] = */   15,   16,   17,   18,   19,   20,   21,   22,
+	/* [58…5F] = */   23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [60…67] = */ 0xFF,    0,    1,    2,    3,    4,    5,    6,
+	/* [68…6F] = */    7,    8,    9,   10,   11,   12,   13,   14,
+	/* [70…77] = */   15,   16,   17,   18,   19,   20,   21,   22,
+	/* [78…7F] = */   23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [80…87] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [88…8F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [90…97] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [98…9F] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [A0…A7] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [A8…AF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [B0…B7] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [B8…BF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [C0…C7] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [C8…CF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [D0…D7] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [D8…DF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [E0…E7] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [E8…EF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [F0…F7] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	/* [F8…FF] = */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/* Decode the base32 string SRC of length LEN into DST, which must have
+   room for LEN * 5 / 8 bytes.  Returns LEN on success or the position of
+   the first invalid character.  Whole blocks are decoded by b32blks(),
+   which is vectorized where possible; what it leaves over is decoded
+   here a character at a time. */
+size_t
 b32toa(uint8_t *restrict dst, const char *restrict src, size_t len)
 {
 	assert(len != 0);
 
-	size_t i, j;
-	for (i = j = 0; len - i >= 8; i += 8, j += 5) {
-		uint8_t bits[] = {
-			lookup[(uint8_t)src[i + 0]],
-			lookup[(uint8_t)src[i + 1]],
-			lookup[(uint8_t)src[i + 2]],
-			lookup[(uint8_t)src[i + 3]],
-			lookup[(uint8_t)src[i + 4]],
-			lookup[(uint8_t)src[i + 5]],
-			lookup[(uint8_t)src[i + 6]],
-			lookup[(uint8_t)src[i + 7]],
-		};
-		if (!b32blktoa(dst + j, bits))
-			return false;
+	size_t i = b32blks(dst, src, len);
+	dst += i / 8 * 5;
+
+	uint32_t acc = 0;
+	int nbits = 0;
+	for (; i < len; i++) {
+		uint8_t v = b32lookup[(uint8_t)src[i]];
+		if (v == 0xFF)
+			return i;
+		acc = acc << 5 | v;
+		if ((nbits += 5) >= 8)
+			*dst++ = (uint8_t)(acc >> (nbits -= 8));
 	}
+	return len;
+}
 
-	uint8_t bits[8] = {0};
-	switch (len - i) {
-	case 7: bits[6] = lookup[(uint8_t)src[i + 6]]; /* fallthrough */
-	case 6: bits[5] = lookup[(uint8_t)src[i + 5]]; /* fallthrough */
-	case 5: bits[4] = lookup[(uint8_t)src[i + 4]]; /* fallthrough */
-	case 4: bits[3] = lookup[(uint8_t)src[i + 3]]; /* fallthrough */
-	case 3: bits[2] = lookup[(uint8_t)src[i + 2]]; /* fallthrough */
-	case 2: bits[1] = lookup[(uint8_t)src[i + 1]]; /* fallthrough */
-	case 1: bits[0] = lookup[(uint8_t)src[i + 0]];
-		return b32blktoa(dst + j, bits);
+/* Decode the base32 string SRC of length LEN into DST like b32toa(),
+   but tolerating the things people paste: any case, spaces, tabs, and
+   hyphens between characters, and any amount of padding at the end,
+   including none.  Decoding picks up where the previous call with the
+   same ST left off.  DST must have room for LEN * 5 / 8 bytes, plus one
+   if ST holds bits left over from a previous call, and the number of
+   bytes actually decoded is stored in *N.  Returns LEN on success or the
+   position of the first invalid character, where a character after the
+   padding counts as invalid. */
+size_t
+b32toalax(uint8_t *restrict dst, const char *restrict src, size_t len,
+          size_t *n, b32lax_t *st)
+{
+	uint8_t *p = dst;
+	uint32_t acc = st->acc;
+	int nbits = st->nbits;
+	bool pad = st->pad;
+
+	for (size_t i = 0; i < len; i++) {
+		uint8_t v = b32lax[(uint8_t)src[i]];
+		if (v < 32 && !pad) {
+			acc = acc << 5 | v;
+			if ((nbits += 5) >= 8)
+				*p++ = (uint8_t)(acc >> (nbits -= 8));
+		} else if (v == LAXPAD)
+			pad = true;
+		else if (v != LAXSKIP)
+			return i;
 	}
-	return true;
+
+	st->acc = acc;
+	st->nbits = nbits;
+	st->pad = pad;
+	*n = (size_t)(p - dst);
+	return len;
 }
 
-bool
-b32blktoa(uint8_t *restrict dst, const uint8_t *restrict src)
+/* Decode the N base32 strings SRC with lengths LEN into the key blocks
+   DST, zeroing everything past the end of each key.  Returns a mask with
+   bit K set if SRC[K] was invalid.
+
+   Short secrets barely fill a vector, so rather than decoding them one at
+   a time the batch is transposed: row I of the matrix holds character I
+   of every secret.  Validation, translation and bit packing then work on
+   whole rows with no dependence between lanes, which the compiler turns
+   into vertical SIMD for whichever instruction set it targets. */
+uint32_t
+b32batch(uint8_t (*restrict dst)[B32KEYBLK], const char *const *restrict src,
+         const size_t *restrict len, size_t n)
 {
-	uint8_t or = src[0] | src[1] | src[2] | src[3]
-	           | src[4] | src[5] | src[6] | src[7];
-	if (or == 0xFF)
-		return false;
-
-	dst[0] = src[0]<<3 | src[1]>>2;
-	dst[1] = src[1]<<6 | src[2]<<1 | src[3]>>4;
-	dst[2] = src[3]<<4 | src[4]>>1;
-	dst[3] = src[4]<<7 | src[5]<<2 | src[6]>>3;
-	dst[4] = src[6]<<5 | src[7]>>0;
-	return true;
+	assert(n <= B32BATCH);
+
+	/* Lanes past N and characters past the end of a secret are 'A',
+	   which is valid and decodes to zero */
+	uint8_t m[B32BATCHLEN][B32BATCH];
+	memset(m, 'A', sizeof(m));
+	for (size_t k = 0; k < n; k++) {
+		assert(len[k] <= B32BATCHLEN);
+		for (size_t i = 0; i < len[k]; i++)
+			m[i][k] = (uint8_t)src[k][i];
+	}
+
+	/* As in b32lookup, ‘=’ is valid and decodes to zero, so that a
+	   secret decodes the same here as with b32toa() */
+	uint8_t bad[B32BATCH] = {0};
+	for (size_t i = 0; i < B32BATCHLEN; i++) {
+		for (size_t k = 0; k < B32BATCH; k++) {
+			uint8_t a = (uint8_t)(m[i][k] - 'A'),
+			        d = (uint8_t)(m[i][k] - '2');
+			uint8_t isa = (uint8_t)-(a < 26),
+			        isd = (uint8_t)-(d < 6),
+			        isp = (uint8_t)-(m[i][k] == '=');
+			m[i][k] = (uint8_t)((a & isa) | ((d + 26) & isd));
+			bad[k] |= (uint8_t)~(isa | isd | isp);
+		}
+	}
+
+	/* Every 8 rows of values become 5 rows of bytes */
+	uint8_t out[B32BATCHLEN * 5 / 8][B32BATCH];
+	for (size_t i = 0, j = 0; i < B32BATCHLEN; i += 8, j += 5) {
+		for (size_t k = 0; k < B32BATCH; k++) {
+			const uint8_t v0 = m[i + 0][k], v1 = m[i + 1][k],
+			              v2 = m[i + 2][k], v3 = m[i + 3][k],
+			              v4 = m[i + 4][k], v5 = m[i + 5][k],
+			              v6 = m[i + 6][k], v7 = m[i + 7][k];
+			out[j + 0][k] = (uint8_t)(v0<<3 | v1>>2);
+			out[j + 1][k] = (uint8_t)(v1<<6 | v2<<1 | v3>>4);
+			out[j + 2][k] = (uint8_t)(v3<<4 | v4>>1);
+			out[j + 3][k] = (uint8_t)(v4<<7 | v5<<2 | v6>>3);
+			out[j + 4][k] = (uint8_t)(v6<<5 | v7>>0);
+		}
+	}
+
+	uint32_t mask = 0;
+	for (size_t k = 0; k < n; k++) {
+		size_t keysz = len[k] * 5 / 8;
+		for (size_t j = 0; j < keysz; j++)
+			dst[k][j] = out[j][k];
+		memset(dst[k] + keysz, 0, B32KEYBLK - keysz);
+		mask |= (uint32_t)(bad[k] != 0) << k;
+	}
+	return mask;
+}
+
+/* Encode the N bytes at SRC as unpadded base32 into DST, which must have
+   room for B32LEN(N) bytes, and return the encoded length.  Whole 5-byte
+   blocks are encoded by b32encblks(), the inverse of b32blks(); since
+   blocks encode to exactly 8 characters, strings of keys whose length is
+   a multiple of 5 can be encoded in one go and split afterwards. */
+size_t
+atob32(char *restrict dst, const uint8_t *restrict src, size_t n)
+{
+	size_t i = b32encblks(dst, src, n);
+	size_t j = i / 5 * 8;
+
+	uint32_t acc = 0;
+	int nbits = 0;
+	for (; i < n; i++) {
+		acc = acc << 8 | src[i];
+		for (nbits += 8; nbits >= 5; nbits -= 5)
+			dst[j++] = b32alphabet[acc >> (nbits - 5) & 0x1F];
+	}
+	if (nbits > 0)
+		dst[j++] = b32alphabet[acc << (5 - nbits) & 0x1F];
+	return j;
 }
@@ -5,6 +5,29 @@
 #include <stddef.h>
 #include <stdint.h>
 
-bool b32toa(uint8_t *restrict, const char *restrict, size_t);
+/* The length of the unpadded base32 encoding of N bytes */
+#define B32LEN(n) (((n) * 8 + 4) / 5)
+
+/* b32batch() decodes up to B32BATCH secrets of at most B32BATCHLEN
+   characters at once into zero-padded key blocks of B32KEYBLK bytes, the
+   HMAC-SHA1 block size */
+#define B32BATCH    (32)
+#define B32BATCHLEN (32)
+#define B32KEYBLK   (64)
+
+/* The state b32toalax() carries from one call to the next, so that a
+   secret can be decoded a piece at a time.  Zero it before the first. */
+typedef struct {
+	uint32_t acc;
+	int nbits;
+	bool pad;
+} b32lax_t;
+
+size_t b32toa(uint8_t *restrict, const char *restrict, size_t);
+size_t b32toalax(uint8_t *restrict, const char *restrict, size_t, size_t *,
+                 b32lax_t *);
+uint32_t b32batch(uint8_t (*restrict)[B32KEYBLK], const char *const *restrict,
+                  const size_t *restrict, size_t);
+size_t atob32(char *restrict, const uint8_t *restrict, size_t);
 
 #endif /* !TOTP_BASE32_H */
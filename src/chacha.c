@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "chacha.h"
+#include "common.h"
+#include "xendian.h"
+
+/* Blocks computed side by side; see chacha20() */
+#define LANES (8)
+
+#define ROTL(x, n) ((x) << (n) | (x) >> (32 - (n)))
+
+static inline void qround(uint32_t (*)[LANES], int, int, int, int)
+	__attribute__((always_inline));
+
+/* Write the N blocks of the ChaCha20 keystream for KEY and NONCE starting
+   at block CTR to DST, as described in RFC 8439 section 2.3.
+
+   Like b32batch() the state is transposed: word I of LANES consecutive
+   blocks sits in row I, so every step of a round is the same operation
+   over a whole row and the compiler is free to vectorize it. */
+void
+chacha20(uint8_t *restrict dst, const uint8_t key[restrict static CHACHAKEYSZ],
+         const uint8_t nonce[restrict static CHACHANONCESZ], uint32_t ctr,
+         size_t n)
+{
+	uint32_t in[16];
+	in[0] = 0x61707865;
+	in[1] = 0x3320646E;
+	in[2] = 0x79622D32;
+	in[3] = 0x6B206574;
+	for (int i = 0; i < 8; i++) {
+		memcpy(in + 4 + i, key + i*4, 4);
+		in[4 + i] = le32toh(in[4 + i]);
+	}
+	for (int i = 0; i < 3; i++) {
+		memcpy(in + 13 + i, nonce + i*4, 4);
+		in[13 + i] = le32toh(in[13 + i]);
+	}
+
+	while (n > 0) {
+		uint32_t x[16][LANES];
+		for (int i = 0; i < 16; i++) {
+			for (int k = 0; k < LANES; k++)
+				x[i][k] = in[i];
+		}
+		for (int k = 0; k < LANES; k++)
+			x[12][k] = ctr + (uint32_t)k;
+
+		for (int i = 0; i < 10; i++) {
+			qround(x, 0, 4,  8, 12);
+			qround(x, 1, 5,  9, 13);
+			qround(x, 2, 6, 10, 14);
+			qround(x, 3, 7, 11, 15);
+			qround(x, 0, 5, 10, 15);
+			qround(x, 1, 6, 11, 12);
+			qround(x, 2, 7,  8, 13);
+			qround(x, 3, 4,  9, 14);
+		}
+
+		size_t m = n < LANES ? n : LANES;
+		for (size_t k = 0; k < m; k++) {
+			for (int i = 0; i < 16; i++) {
+				uint32_t w = i == 12 ? ctr + (uint32_t)k : in[i];
+				w = htole32(x[i][k] + w);
+				memcpy(dst + i*4, &w, 4);
+			}
+			dst += CHACHABLKSZ;
+		}
+		ctr += (uint32_t)m;
+		n -= m;
+	}
+}
+
+void
+qround(uint32_t (*x)[LANES], int a, int b, int c, int d)
+{
+	for (int k = 0; k < LANES; k++) {
+		x[a][k] += x[b][k]; x[d][k] ^= x[a][k]; x[d][k] = ROTL(x[d][k], 16);
+		x[c][k] += x[d][k]; x[b][k] ^= x[c][k]; x[b][k] = ROTL(x[b][k], 12);
+		x[a][k] += x[b][k]; x[d][k] ^= x[a][k]; x[d][k] = ROTL(x[d][k],  8);
+		x[c][k] += x[d][k]; x[b][k] ^= x[c][k]; x[b][k] = ROTL(x[b][k],  7);
+	}
+}
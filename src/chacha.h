@@ -0,0 +1,14 @@
+#ifndef TOTP_CHACHA_H
+#define TOTP_CHACHA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHACHAKEYSZ   (32)
+#define CHACHANONCESZ (12)
+#define CHACHABLKSZ   (64)
+
+void chacha20(uint8_t *restrict, const uint8_t [restrict static CHACHAKEYSZ],
+              const uint8_t [restrict static CHACHANONCESZ], uint32_t, size_t);
+
+#endif /* !TOTP_CHACHA_H */
@@ -0,0 +1,108 @@
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acctab.h"
+#include "codeidx.h"
+#include "common.h"
+#include "totp.h"
+
+#define TAG(code, digits) ((uint64_t)(digits) << 32 | (code))
+
+static inline codeidx_slot_t *probe(const codeidx_t *, uint64_t)
+	__attribute__((always_inline));
+
+void
+codeidx_init(codeidx_t *ci, const acctab_t *tab)
+{
+	size_t n = tab->n;
+	ci->tab = tab;
+	ci->expires = 0;
+
+	/* Keep the load factor at or below ½ */
+	for (ci->nslots = 16; ci->nslots < n * 2; ci->nslots <<= 1)
+		;
+
+	ci->slots = calloc(ci->nslots, sizeof(*ci->slots));
+	ci->idx = calloc(n ? n : 1, sizeof(*ci->idx));
+	ci->tags = calloc(n ? n : 1, sizeof(*ci->tags));
+	if (ci->slots == NULL || ci->idx == NULL || ci->tags == NULL)
+		err(1, "calloc");
+}
+
+void
+codeidx_free(codeidx_t *ci)
+{
+	free(ci->slots);
+	free(ci->idx);
+	free(ci->tags);
+}
+
+/* Recompute the code of every account for the time NOW and rebuild the
+   index from scratch.  This is a counting sort over the hash slots: the
+   first pass counts the accounts per code, the second assigns each code
+   its offset into IDX, and the third scatters the account indices. */
+void
+codeidx_build(codeidx_t *ci, time_t now)
+{
+	memset(ci->slots, 0, ci->nslots * sizeof(*ci->slots));
+
+	const acctab_t *t = ci->tab;
+	for (size_t i = 0; i < t->n; i++) {
+		uint64_t step = (uint64_t)now / t->periods[i];
+		uint32_t code = hotp(t->keys + i, step) % pow32(10, t->digits[i]);
+
+		time_t next = (time_t)((step + 1) * t->periods[i]);
+		if (i == 0 || next < ci->expires)
+			ci->expires = next;
+
+		ci->tags[i] = TAG(code, t->digits[i]);
+		codeidx_slot_t *s = probe(ci, ci->tags[i]);
+		s->tag = ci->tags[i];
+		s->cnt++;
+	}
+
+	uint32_t off = 0;
+	for (size_t i = 0; i < ci->nslots; i++) {
+		ci->slots[i].off = off;
+		off += ci->slots[i].cnt;
+		ci->slots[i].cnt = 0;
+	}
+
+	for (size_t i = 0; i < t->n; i++) {
+		codeidx_slot_t *s = probe(ci, ci->tags[i]);
+		ci->idx[s->off + s->cnt++] = (uint32_t)i;
+	}
+}
+
+/* Rebuild the index only if some account has entered a new period since
+   the last build. */
+void
+codeidx_refresh(codeidx_t *ci, time_t now)
+{
+	if (now >= ci->expires)
+		codeidx_build(ci, now);
+}
+
+/* Return the indices of all accounts whose current DIGITS-digit code is
+   CODE, storing their count in N.  More than one result means the code
+   collides between accounts and is ambiguous. */
+const uint32_t *
+codeidx_lookup(const codeidx_t *ci, uint32_t code, int digits, size_t *n)
+{
+	const codeidx_slot_t *s = probe(ci, TAG(code, digits));
+	*n = s->cnt;
+	return ci->idx + s->off;
+}
+
+codeidx_slot_t *
+probe(const codeidx_t *ci, uint64_t tag)
+{
+	size_t mask = ci->nslots - 1;
+	size_t i = (size_t)((tag * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+	/* The digit count is always non-zero, so a zero tag marks an empty
+	   slot */
+	while (ci->slots[i].tag != 0 && ci->slots[i].tag != tag)
+		i = (i + 1) & mask;
+	return ci->slots + i;
+}
@@ -0,0 +1,38 @@
+#ifndef TOTP_CODEIDX_H
+#define TOTP_CODEIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "acctab.h"
+
+/* An inverted index from the current code of each account to the
+   accounts that produce it.  Matching accounts for a code are stored
+   contiguously in ACCTS so that a lookup is a single probe sequence
+   followed by a slice. */
+
+typedef struct {
+	uint64_t tag;
+	uint32_t off, cnt;
+} codeidx_slot_t;
+
+typedef struct {
+	const acctab_t *tab;
+
+	codeidx_slot_t *slots;
+	size_t nslots;
+	uint32_t *idx;
+	uint64_t *tags;
+
+	/* The first second at which some account’s code rolls over */
+	time_t expires;
+} codeidx_t;
+
+void codeidx_init(codeidx_t *, const acctab_t *);
+void codeidx_free(codeidx_t *);
+void codeidx_build(codeidx_t *, time_t);
+void codeidx_refresh(codeidx_t *, time_t);
+const uint32_t *codeidx_lookup(const codeidx_t *, uint32_t, int, size_t *);
+
+#endif /* !TOTP_CODEIDX_H */
@@ -0,0 +1,295 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acctab.h"
+#include "codetab.h"
+#include "common.h"
+#include "hash.h"
+#include "totp.h"
+#include "xendian.h"
+
+/* Number of accounts a worker claims at a time */
+#define BATCHSZ (64)
+
+struct worker {
+	const acctab_t *tab;
+	uint8_t *rows;
+	uint64_t rowsz, epoch;
+	uint32_t mod, nsteps, bits;
+	atomic_size_t next;
+};
+
+static void *work(void *);
+static int byid(const void *, const void *);
+static inline void fillrow(uint8_t *, const hmac_sha1_key_t *, uint32_t,
+                           uint64_t, uint32_t, uint32_t)
+	__attribute__((always_inline));
+
+/* Write the codes of the accounts in TAB, identified by IDS, for NSTEPS
+   time steps starting with the one containing NOW.  If NSTEPS is 0 the
+   table covers one week.  The steps are those of the accounts’ own
+   period, which must be the same for all of them. */
+void
+codetab_write(const char *path, const acctab_t *tab, const uint64_t *ids,
+              uint64_t now, uint32_t nsteps, int nthreads)
+{
+	size_t naccts = tab->n;
+	if (naccts == 0)
+		errx(1, "%s: no accounts to write", path);
+	if (naccts > UINT32_MAX)
+		errx(1, "%s: too many accounts", path);
+	for (size_t i = 1; i < naccts; i++) {
+		if (tab->digits[i] != tab->digits[0]
+		 || tab->periods[i] != tab->periods[0])
+		{
+			errx(1, "%s: all accounts must share the same digits and period",
+			     path);
+		}
+	}
+
+	uint32_t period = tab->periods[0];
+	if (nsteps == 0)
+		nsteps = 7 * 24 * 60 * 60 / period;
+	if (nsteps == 0)
+		nsteps = 1;
+	uint64_t epoch = now / period;
+
+	uint32_t mod = pow32(10, tab->digits[0]);
+	uint32_t bits = 32 - (uint32_t)__builtin_clz(mod - 1 | 1);
+	uint64_t rowsz = ((uint64_t)nsteps * bits + 63) / 64 * 8;
+	size_t hdrsz = sizeof(codetab_hdr_t) + naccts * sizeof(codetab_ent_t);
+	size_t mapsz = hdrsz + naccts * rowsz + sizeof(uint64_t);
+
+	/* Build the index first so that a duplicate ID is reported before
+	   the file is touched.  Equal neighbours in the sorted index are
+	   accounts that could never be told apart. */
+	codetab_ent_t *ents = malloc(naccts * sizeof(*ents));
+	if (ents == NULL)
+		err(1, "malloc");
+	for (size_t i = 0; i < naccts; i++)
+		ents[i] = (codetab_ent_t){.id = ids[i], .row = (uint32_t)i};
+	qsort(ents, naccts, sizeof(*ents), byid);
+	for (size_t i = 0; i < naccts; i++) {
+		if (i + 1 < naccts && ents[i].id == ents[i + 1].id) {
+			const char *l = acctab_label(tab, ents[i + 1].row);
+			errx(1, "%s: duplicate account ID", l != NULL ? l : "");
+		}
+		ents[i].id = htole64(ents[i].id);
+		ents[i].row = htole32(ents[i].row);
+	}
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	if (ftruncate(fd, (off_t)mapsz) == -1)
+		err(1, "ftruncate: %s", path);
+	uint8_t *map = mmap(NULL, mapsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		err(1, "mmap: %s", path);
+	close(fd);
+
+	codetab_hdr_t hdr = {
+		.magic   = CODETAB_MAGIC,
+		.version = htole32(CODETAB_VERSION),
+		.period  = htole32(period),
+		.epoch   = htole64(epoch),
+		.nsteps  = htole32(nsteps),
+		.naccts  = htole32((uint32_t)naccts),
+		.digits  = htole32((uint32_t)tab->digits[0]),
+		.bits    = htole32(bits),
+		.rowsz   = htole64(rowsz),
+	};
+	memcpy(map, &hdr, sizeof(hdr));
+	memcpy(map + sizeof(hdr), ents, naccts * sizeof(*ents));
+	free(ents);
+
+	struct worker w = {
+		.tab    = tab,
+		.rows   = map + hdrsz,
+		.rowsz  = rowsz,
+		.epoch  = epoch,
+		.mod    = mod,
+		.nsteps = nsteps,
+		.bits   = bits,
+	};
+
+	if (nthreads <= 0)
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads <= 0)
+		nthreads = 1;
+
+	pthread_t *thrds = calloc((size_t)nthreads, sizeof(*thrds));
+	if (thrds == NULL)
+		err(1, "calloc");
+	for (int i = 1; i < nthreads; i++) {
+		if ((errno = pthread_create(thrds + i, NULL, work, &w)) != 0)
+			err(1, "pthread_create");
+	}
+	work(&w);
+	for (int i = 1; i < nthreads; i++)
+		pthread_join(thrds[i], NULL);
+	free(thrds);
+
+	if (munmap(map, mapsz) == -1)
+		err(1, "munmap: %s", path);
+}
+
+int
+byid(const void *a, const void *b)
+{
+	uint64_t x = ((const codetab_ent_t *)a)->id;
+	uint64_t y = ((const codetab_ent_t *)b)->id;
+	return (x > y) - (x < y);
+}
+
+void *
+work(void *arg)
+{
+	struct worker *w = arg;
+	size_t i;
+	size_t n = w->tab->n;
+	while ((i = atomic_fetch_add(&w->next, BATCHSZ)) < n) {
+		size_t end = i + BATCHSZ < n ? i + BATCHSZ : n;
+		for (; i < end; i++) {
+			fillrow(w->rows + i * w->rowsz, w->tab->keys + i, w->mod,
+			        w->epoch, w->nsteps, w->bits);
+		}
+	}
+	return NULL;
+}
+
+/* Pack the codes modulo MOD of the account with midstates KEY into the
+   bitstream at ROW.  Codes are accumulated into a 64-bit word which is
+   flushed whenever it fills up; a code straddling two words has its high
+   bits carried over. */
+void
+fillrow(uint8_t *row, const hmac_sha1_key_t *key, uint32_t mod,
+        uint64_t epoch, uint32_t nsteps, uint32_t bits)
+{
+	uint64_t acc = 0, w;
+	uint32_t fill = 0;
+
+	for (uint32_t k = 0; k < nsteps; k++) {
+		uint64_t code = hotp(key, epoch + k) % mod;
+		acc |= code << fill;
+		fill += bits;
+		if (fill >= 64) {
+			w = htole64(acc);
+			memcpy(row, &w, sizeof(w));
+			row += sizeof(w);
+			fill -= 64;
+			acc = fill != 0 ? code >> (bits - fill) : 0;
+		}
+	}
+	if (fill != 0) {
+		w = htole64(acc);
+		memcpy(row, &w, sizeof(w));
+	}
+}
+
+void
+codetab_open(codetab_t *t, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	if (fstat(fd, &st) == -1)
+		err(1, "fstat: %s", path);
+	if ((size_t)st.st_size < sizeof(codetab_hdr_t))
+		errx(1, "%s: not a code table", path);
+
+	t->mapsz = (size_t)st.st_size;
+	t->map = mmap(NULL, t->mapsz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (t->map == MAP_FAILED)
+		err(1, "mmap: %s", path);
+	close(fd);
+
+	t->hdr = (const codetab_hdr_t *)t->map;
+	if (memcmp(t->hdr->magic, CODETAB_MAGIC, sizeof(t->hdr->magic)) != 0)
+		errx(1, "%s: not a code table", path);
+	if (le32toh(t->hdr->version) != CODETAB_VERSION)
+		errx(1, "%s: unsupported code table version %u", path,
+		     le32toh(t->hdr->version));
+
+	t->period = le32toh(t->hdr->period);
+	t->epoch  = le64toh(t->hdr->epoch);
+	t->nsteps = le32toh(t->hdr->nsteps);
+	t->naccts = le32toh(t->hdr->naccts);
+	t->digits = (int)le32toh(t->hdr->digits);
+	t->bits   = le32toh(t->hdr->bits);
+	t->rowsz  = le64toh(t->hdr->rowsz);
+
+	/* The rows are bounded by division, as ROWSZ comes from the file and
+	   their total size could wrap */
+	size_t hdrsz = sizeof(codetab_hdr_t) + t->naccts * sizeof(codetab_ent_t);
+	if (t->period == 0 || t->bits == 0 || t->bits > 32
+	 || t->rowsz < ((uint64_t)t->nsteps * t->bits + 7) / 8
+	 || t->mapsz < hdrsz + sizeof(uint64_t)
+	 || (t->naccts != 0
+	  && t->rowsz > (t->mapsz - hdrsz - sizeof(uint64_t)) / t->naccts))
+	{
+		errx(1, "%s: corrupt code table", path);
+	}
+
+	t->ids = (const codetab_ent_t *)(t->map + sizeof(codetab_hdr_t));
+	t->rows = t->map + hdrsz;
+}
+
+void
+codetab_close(codetab_t *t)
+{
+	munmap((void *)t->map, t->mapsz);
+}
+
+/* Fetch the code of account ACCT at time step STEP into CODE.  Returns
+   false if the table doesn’t cover the given account or step. */
+bool
+codetab_code(const codetab_t *t, size_t acct, uint64_t step, uint32_t *code)
+{
+	if (acct >= t->naccts || step < t->epoch || step - t->epoch >= t->nsteps)
+		return false;
+
+	uint64_t bit = (step - t->epoch) * t->bits, w;
+	memcpy(&w, t->rows + acct * t->rowsz + bit / 8, sizeof(w));
+	*code = (uint32_t)(le64toh(w) >> (bit % 8) & ((1ULL << t->bits) - 1));
+	return true;
+}
+
+/* Find the account identified by S of length N in T by binary search
+   over the account index.  Returns false if there is none. */
+bool
+codetab_find(const codetab_t *t, const char *s, size_t n, size_t *acct)
+{
+	uint64_t id = codetab_id(s, n);
+	size_t lo = 0, hi = t->naccts;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint64_t x = le64toh(t->ids[mid].id);
+		if (x == id) {
+			*acct = le32toh(t->ids[mid].row);
+			return true;
+		}
+		if (x < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+/* Hash an account identifier for the account index */
+uint64_t
+codetab_id(const char *s, size_t n)
+{
+	return fnv1a(FNVBASIS, s, n);
+}
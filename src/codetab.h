@@ -0,0 +1,66 @@
+#ifndef TOTP_CODETAB_H
+#define TOTP_CODETAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acctab.h"
+
+/* A code table holds the precomputed codes of a set of accounts over a
+   contiguous range of time steps, so that codes can be verified without
+   access to the secrets.  All integers are little-endian.  The file
+   consists of:
+
+       1. The header below.
+       2. The account index: NACCTS entries pairing the 64-bit FNV-1a
+          hash of an account identifier with the account’s row, sorted by
+          hash so that an account is found by binary search.
+       3. NACCTS rows of ROWSZ bytes each.  A row is a bitstream of NSTEPS
+          codes of BITS bits each, the first code being that of time step
+          EPOCH.  Rows are padded to a multiple of 8 bytes.
+       4. 8 bytes of padding so that any code can be read with a single
+          unaligned 64-bit load. */
+
+#define CODETAB_MAGIC   "TOTPCTAB"
+#define CODETAB_VERSION (1)
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t period;
+	uint64_t epoch;
+	uint32_t nsteps;
+	uint32_t naccts;
+	uint32_t digits;
+	uint32_t bits;
+	uint64_t rowsz;
+} codetab_hdr_t;
+
+typedef struct {
+	uint64_t id;
+	uint32_t row;
+	uint32_t pad;
+} codetab_ent_t;
+
+typedef struct {
+	const uint8_t *map;
+	size_t mapsz;
+	const codetab_hdr_t *hdr;
+	const codetab_ent_t *ids;
+	const uint8_t *rows;
+	uint64_t epoch, rowsz;
+	uint32_t nsteps, naccts, bits, period;
+	int digits;
+} codetab_t;
+
+void codetab_write(const char *, const acctab_t *, const uint64_t *,
+                   uint64_t, uint32_t, int);
+void codetab_open(codetab_t *, const char *);
+void codetab_close(codetab_t *);
+bool codetab_code(const codetab_t *, size_t, uint64_t, uint32_t *);
+bool codetab_find(const codetab_t *, const char *, size_t, size_t *);
+uint64_t codetab_id(const char *, size_t)
+	__attribute__((pure));
+
+#endif /* !TOTP_CODETAB_H */
@@ -0,0 +1,183 @@
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base32.h"
+#include "dedup.h"
+#include "hash.h"
+#include "totp.h"
+
+#define NIL UINT32_MAX
+
+static uint32_t lookup(dedup_t *, const uint8_t *, size_t, int, uint64_t);
+static uint32_t evict(dedup_t *);
+static void detach(dedup_t *, uint32_t);
+static void push(dedup_t *, uint32_t);
+static inline uint64_t hash(const uint8_t *, size_t, int)
+	__attribute__((always_inline, pure));
+
+/* Initialize D with room for CAP distinct keys, decoding secrets
+   leniently if LAX is true */
+void
+dedup_init(dedup_t *d, size_t cap, bool lax)
+{
+	if (cap == 0 || cap >= NIL / 2)
+		errx(1, "%zu: invalid dedup table size", cap);
+
+	size_t nb = 1;
+	while (nb < cap * 2)
+		nb <<= 1;
+
+	d->cap = (uint32_t)cap;
+	d->mask = (uint32_t)nb - 1;
+	d->used = 0;
+	d->head = d->tail = NIL;
+	d->lax = lax;
+	if ((d->ents = malloc(cap * sizeof(*d->ents))) == NULL
+	    || (d->buckets = malloc(nb * sizeof(*d->buckets))) == NULL)
+	{
+		err(1, "malloc");
+	}
+	memset(d->buckets, 0xFF, nb * sizeof(*d->buckets));
+}
+
+void
+dedup_free(dedup_t *d)
+{
+	free(d->ents);
+	free(d->buckets);
+}
+
+/* Compute the 31-bit HOTP value of the base32 secret S of length N for
+   the counter CTR, as by b32key() and hotp().  The key is only derived,
+   and the HMAC only computed, the first time a given key and PERIOD are
+   seen for a given counter.  Returns KEYOK or the reason S was
+   rejected. */
+int
+dedup_hotp(dedup_t *d, uint32_t *trunc, const char *s, size_t n, int period,
+           uint64_t ctr)
+{
+	size_t m = n;
+	if (!d->lax) {
+		while (m > 0 && s[m - 1] == '=')
+			m--;
+	}
+	if (m == 0)
+		return KEYEMPTY;
+
+	/* Too long to cache; go the slow way.  Lenient secrets can only
+	   decode to fewer bytes than this. */
+	size_t len = m * 5 / 8;
+	if (len > DDKEYMAX) {
+		int e;
+		hmac_sha1_key_t k;
+		if ((e = b32key(&k, s, n, d->lax)) == KEYOK)
+			*trunc = hotp(&k, ctr);
+		return e;
+	}
+
+	uint8_t bytes[DDKEYMAX];
+	if (!d->lax) {
+		if (b32toa(bytes, s, m) != m)
+			return KEYINVAL;
+	} else {
+		if (b32toalax(bytes, s, m, &len, &(b32lax_t){0}) != m)
+			return KEYINVAL;
+		if (len == 0)
+			return KEYEMPTY;
+	}
+
+	dedup_ent_t *e = d->ents + lookup(d, bytes, len, period, ctr);
+	*trunc = e->trunc;
+	return KEYOK;
+}
+
+/* Find or create the entry for BYTES and PERIOD, mark it as the most
+   recently used, and bring its HOTP value up to date for CTR */
+uint32_t
+lookup(dedup_t *d, const uint8_t *bytes, size_t len, int period, uint64_t ctr)
+{
+	uint64_t h = hash(bytes, len, period);
+	uint32_t *b = d->buckets + (h & d->mask), i;
+
+	for (i = *b; i != NIL; i = d->ents[i].chain) {
+		dedup_ent_t *e = d->ents + i;
+		if (e->hash == h && e->period == period && e->len == len
+		    && memcmp(e->bytes, bytes, len) == 0)
+		{
+			detach(d, i);
+			push(d, i);
+			if (e->ctr != ctr) {
+				e->ctr = ctr;
+				e->trunc = hotp(&e->key, ctr);
+			}
+			return i;
+		}
+	}
+
+	i = d->used < d->cap ? d->used++ : evict(d);
+	dedup_ent_t *e = d->ents + i;
+	e->hash = h;
+	e->period = period;
+	e->len = (uint8_t)len;
+	memcpy(e->bytes, bytes, len);
+	hmac_sha1key(&e->key, bytes, len);
+	e->ctr = ctr;
+	e->trunc = hotp(&e->key, ctr);
+
+	e->chain = *b;
+	*b = i;
+	push(d, i);
+	return i;
+}
+
+/* Remove the least recently used entry from the table and return it */
+uint32_t
+evict(dedup_t *d)
+{
+	uint32_t i = d->tail;
+	detach(d, i);
+
+	uint32_t *p = d->buckets + (d->ents[i].hash & d->mask);
+	while (*p != i)
+		p = &d->ents[*p].chain;
+	*p = d->ents[i].chain;
+	return i;
+}
+
+void
+detach(dedup_t *d, uint32_t i)
+{
+	dedup_ent_t *e = d->ents + i;
+	if (e->prev != NIL)
+		d->ents[e->prev].next = e->next;
+	else
+		d->head = e->next;
+	if (e->next != NIL)
+		d->ents[e->next].prev = e->prev;
+	else
+		d->tail = e->prev;
+}
+
+void
+push(dedup_t *d, uint32_t i)
+{
+	dedup_ent_t *e = d->ents + i;
+	e->prev = NIL;
+	e->next = d->head;
+	if (d->head != NIL)
+		d->ents[d->head].prev = i;
+	else
+		d->tail = i;
+	d->head = i;
+}
+
+/* FNV-1a over the key bytes followed by the period */
+uint64_t
+hash(const uint8_t *p, size_t n, int period)
+{
+	uint64_t h = fnv1a(FNVBASIS, p, n);
+	h ^= (uint64_t)period;
+	h *= FNVPRIME;
+	return h;
+}
@@ -0,0 +1,42 @@
+#ifndef TOTP_DEDUP_H
+#define TOTP_DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hmac.h"
+
+/* Decoded keys longer than this are never cached */
+#define DDKEYMAX (64)
+
+/* A cache of HMAC keys and their most recent HOTP values, keyed by the
+   decoded key bytes and the period.  Entries are preallocated and, once
+   they are all in use, the least recently used one is recycled. */
+
+typedef struct {
+	hmac_sha1_key_t key;
+	uint64_t hash, ctr;
+	uint32_t trunc;
+	uint32_t chain, prev, next;
+	int period;
+	uint8_t len, bytes[DDKEYMAX];
+} dedup_ent_t;
+
+typedef struct {
+	dedup_ent_t *ents;
+	uint32_t *buckets;
+	uint32_t cap, used, mask;
+
+	/* Most and least recently used entries */
+	uint32_t head, tail;
+
+	/* Decode secrets with b32toalax() */
+	bool lax;
+} dedup_t;
+
+void dedup_init(dedup_t *, size_t, bool);
+void dedup_free(dedup_t *);
+int dedup_hotp(dedup_t *, uint32_t *, const char *, size_t, int, uint64_t);
+
+#endif /* !TOTP_DEDUP_H */
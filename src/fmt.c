@@ -0,0 +1,435 @@
+#include <limits.h>
+#include <string.h>
+
+#include "codetab.h"
+#include "common.h"
+#include "fmt.h"
+#include "totp.h"
+#include "uri.h"
+#include "xendian.h"
+
+static int parseuri(fields_t *, const char *, size_t);
+static bool getint(const char *, size_t, int, int *);
+static char *fmtu64(char *, uint64_t);
+static char *fmtjson(char *, const char *, size_t);
+static char *fmtcsv(char *, const char *, size_t);
+static char *fmtbin(char *, const record_t *, int);
+
+/* Split the line S of length N into its fields.  Untagged lines are
+   just a secret.  Tagged lines are of the form
+
+       id TAB secret [TAB digits [TAB period [TAB algorithm]]]
+
+   where empty or missing optional fields take their defaults from CFG.
+   If CFG->uri is set the secret is an otpauth:// URI whose parameters
+   take precedence over CFG but not over the fields of a tagged line.
+   Nothing is copied; the fields point into S. */
+int
+parsefields(fields_t *f, const char *s, size_t n, const fmtcfg_t *cfg)
+{
+	f->digits = cfg->digits;
+	f->period = cfg->period;
+	f->hotp = false;
+
+	if (!cfg->tagged) {
+		f->id = NULL;
+		f->idn = 0;
+		if (cfg->uri)
+			return parseuri(f, s, n);
+		f->sec = s;
+		f->secn = n;
+		return KEYOK;
+	}
+
+	const char *end = s + n, *tab = memchr(s, '\t', n);
+	if (tab == NULL)
+		return RECNOSEC;
+	f->id = s;
+	f->idn = (size_t)(tab - s);
+
+	const char *fld[4];
+	size_t len[4];
+	int nf = 0;
+	for (const char *p = tab + 1; nf < 4; nf++) {
+		tab = memchr(p, '\t', (size_t)(end - p));
+		fld[nf] = p;
+		len[nf] = (size_t)((tab != NULL ? tab : end) - p);
+		if (tab == NULL) {
+			nf++;
+			break;
+		}
+		p = tab + 1;
+	}
+
+	int e;
+	if (cfg->uri && (e = parseuri(f, fld[0], len[0])) != KEYOK)
+		return e;
+	if (!cfg->uri) {
+		f->sec = fld[0];
+		f->secn = len[0];
+	}
+	if (nf > 1 && len[1] != 0 && !getint(fld[1], len[1], 9, &f->digits))
+		return RECDIGITS;
+	if (nf > 2 && len[2] != 0 && !getint(fld[2], len[2], INT_MAX, &f->period))
+		return RECPERIOD;
+
+	/* SHA-1 is the only HMAC we implement */
+	if (nf > 3 && len[3] != 0) {
+		static const char sha1[] = "SHA1";
+		if (len[3] != sizeof(sha1) - 1)
+			return RECALGO;
+		for (size_t i = 0; i < len[3]; i++) {
+			char c = fld[3][i];
+			if ((c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c) != sha1[i])
+				return RECALGO;
+		}
+	}
+
+	return KEYOK;
+}
+
+/* Parse the line S of length N and compute its code as of CFG->now.  If
+   DD is not NULL it is used to avoid recomputing repeated secrets. */
+int
+mkrecord(record_t *r, const char *s, size_t n, const fmtcfg_t *cfg,
+         dedup_t *dd)
+{
+	int e;
+	hmac_sha1_key_t key;
+
+	if ((e = parsefields(&r->f, s, n, cfg)) != KEYOK)
+		return e;
+
+	if (dd == NULL) {
+		if ((e = b32key(&key, r->f.sec, r->f.secn, cfg->lax)) != KEYOK)
+			return e;
+		mkcode(r, &key, cfg);
+		return KEYOK;
+	}
+
+	r->ctr = r->f.hotp ? r->f.counter : cfg->now / (uint64_t)r->f.period;
+	e = dedup_hotp(dd, &r->trunc, r->f.sec, r->f.secn, r->f.period, r->ctr);
+	if (e != KEYOK)
+		return e;
+	r->code = r->trunc % pow32(10, r->f.digits);
+	r->left = r->f.hotp ? 0 : (r->ctr + 1) * (uint64_t)r->f.period - cfg->now;
+	return KEYOK;
+}
+
+/* Compute the code of R, whose fields are already filled in, for KEY as
+   of CFG->now */
+void
+mkcode(record_t *r, const hmac_sha1_key_t *key, const fmtcfg_t *cfg)
+{
+	r->ctr = r->f.hotp ? r->f.counter : cfg->now / (uint64_t)r->f.period;
+	r->trunc = hotp(key, r->ctr);
+	r->code = r->trunc % pow32(10, r->f.digits);
+	r->left = r->f.hotp ? 0 : (r->ctr + 1) * (uint64_t)r->f.period - cfg->now;
+}
+
+/* Write the output line for R to DST in the format given by CFG and
+   return a pointer past its end.  DST must have room for at least
+   FMTSZ(R->f.idn) bytes. */
+char *
+fmtrecord(char *dst, const record_t *r, const fmtcfg_t *cfg)
+{
+	switch (cfg->format) {
+	case FMTBIN:
+		return fmtbin(dst, r, cfg->binflags);
+	case FMTJSON:
+		*dst++ = '{';
+		if (r->f.id != NULL) {
+			memcpy(dst, "\"id\":\"", 6);
+			dst = fmtjson(dst + 6, r->f.id, r->f.idn);
+			memcpy(dst, "\",", 2);
+			dst += 2;
+		}
+		memcpy(dst, "\"code\":\"", 8);
+		dst = fmtcode(dst + 8, r->code, r->f.digits);
+		*dst++ = '"';
+		if (cfg->remaining) {
+			memcpy(dst, ",\"remaining\":", 13);
+			dst = fmtu64(dst + 13, r->left);
+		}
+		*dst++ = '}';
+		break;
+	case FMTCSV:
+		if (r->f.id != NULL) {
+			dst = fmtcsv(dst, r->f.id, r->f.idn);
+			*dst++ = ',';
+		}
+		dst = fmtcode(dst, r->code, r->f.digits);
+		if (cfg->remaining) {
+			*dst++ = ',';
+			dst = fmtu64(dst, r->left);
+		}
+		break;
+	default:
+		if (r->f.id != NULL) {
+			memcpy(dst, r->f.id, r->f.idn);
+			dst += r->f.idn;
+			*dst++ = '\t';
+		}
+		dst = fmtcode(dst, r->code, r->f.digits);
+		if (cfg->remaining) {
+			*dst++ = '\t';
+			dst = fmtu64(dst, r->left);
+		}
+	}
+
+	*dst++ = '\n';
+	return dst;
+}
+
+/* Write the output line for the line S of length N to DST according to
+   CFG and return a pointer past its end.  If the line is invalid nothing
+   is written, the reason is stored in ERR and NULL is returned.  This
+   never touches any global state and so may be called from any number
+   of threads at once, so long as each has its own DD. */
+char *
+fmtline(char *restrict dst, const char *restrict s, size_t n,
+        const fmtcfg_t *cfg, dedup_t *dd, int *err)
+{
+	record_t r;
+	if ((*err = mkrecord(&r, s, n, cfg, dd)) != KEYOK)
+		return NULL;
+	return fmtrecord(dst, &r, cfg);
+}
+
+/* Write the placeholder output for the invalid line S of length N to DST
+   and return a pointer past its end.  With ERRSKIP nothing is written.
+   DST must have room for at least FMTSZ(N) bytes. */
+char *
+fmtbad(char *dst, const char *s, size_t n, const fmtcfg_t *cfg)
+{
+	if (cfg->onerr == ERRSKIP)
+		return dst;
+
+	record_t r = {
+		.f.digits = cfg->digits,
+		.trunc    = BINBAD,
+		.code     = BINBAD,
+	};
+
+	/* Keep the ID so that tagged output can still be matched up with the
+	   input; a line with no secret is all ID */
+	if (cfg->tagged) {
+		const char *tab = memchr(s, '\t', n);
+		r.f.id = s;
+		r.f.idn = tab != NULL ? (size_t)(tab - s) : n;
+	}
+
+	switch (cfg->format) {
+	case FMTBIN:
+		return fmtbin(dst, &r, cfg->binflags);
+	case FMTJSON:
+		*dst++ = '{';
+		if (r.f.id != NULL) {
+			memcpy(dst, "\"id\":\"", 6);
+			dst = fmtjson(dst + 6, r.f.id, r.f.idn);
+			memcpy(dst, "\",", 2);
+			dst += 2;
+		}
+		memcpy(dst, "\"code\":null}", 12);
+		dst += 12;
+		break;
+	case FMTCSV:
+		if (r.f.id != NULL) {
+			dst = fmtcsv(dst, r.f.id, r.f.idn);
+			*dst++ = ',';
+		}
+		break;
+	default:
+		if (r.f.id != NULL) {
+			memcpy(dst, r.f.id, r.f.idn);
+			dst += r.f.idn;
+			*dst++ = '\t';
+		}
+		memset(dst, '-', (size_t)cfg->digits);
+		dst += cfg->digits;
+	}
+
+	*dst++ = '\n';
+	return dst;
+}
+
+/* Write CODE zero-padded to DIGITS digits to DST and return a pointer
+   past its end */
+char *
+fmtcode(char *dst, uint32_t code, int digits)
+{
+	for (int i = digits - 1; i >= 0; i--) {
+		dst[i] = (char)('0' + code % 10);
+		code /= 10;
+	}
+	return dst + digits;
+}
+
+/* Write the binary output header for CFG to DST and return its size */
+size_t
+fmthdr(char *dst, const fmtcfg_t *cfg)
+{
+	int f = cfg->binflags;
+	binhdr_t h = {
+		.magic   = BINMAGIC,
+		.version = htole32(BINVERSION),
+		.flags   = htole32((uint32_t)f),
+		.recsz   = htole32(f & (BINCTR | BINID)
+		                   ? (f & BINCTR ? 8 : 0) + (f & BINID ? 8 : 0) + 8
+		                   : 4),
+		.digits  = htole32((uint32_t)cfg->digits),
+		.period  = htole32((uint32_t)cfg->period),
+	};
+	memcpy(dst, &h, sizeof(h));
+	return sizeof(h);
+}
+
+const char *
+fmtstrerror(int e)
+{
+	switch (e) {
+	case KEYEMPTY:
+		return "empty base32 input";
+	case KEYINVAL:
+		return "invalid base32 input";
+	case RECNOSEC:
+		return "missing secret";
+	case RECDIGITS:
+		return "invalid digits";
+	case RECPERIOD:
+		return "invalid period";
+	case RECALGO:
+		return "unsupported algorithm";
+	case RECURI:
+		return "invalid otpauth URI";
+	case RECHOTP:
+		return "HOTP URI has no current code";
+	case RECMIG:
+		return "invalid migration payload";
+	case RECVAULT:
+		return "invalid vault";
+	case RECCRYPT:
+		return "encrypted vaults are not supported";
+	case RECTYPE:
+		return "unsupported OTP type";
+	}
+	return "unknown error";
+}
+
+int
+parseuri(fields_t *f, const char *s, size_t n)
+{
+	uri_t u = {
+		.digits = f->digits,
+		.period = f->period,
+	};
+
+	int e = uri_parse(&u, s, n);
+	if (e != KEYOK)
+		return e;
+	f->sec = u.sec;
+	f->secn = u.secn;
+	f->digits = u.digits;
+	f->period = u.period;
+	f->hotp = u.hotp;
+	f->counter = u.counter;
+	return KEYOK;
+}
+
+bool
+getint(const char *s, size_t n, int max, int *v)
+{
+	long x = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+		if ((x = x * 10 + (s[i] - '0')) > max)
+			return false;
+	}
+	if (x == 0)
+		return false;
+	*v = (int)x;
+	return true;
+}
+
+char *
+fmtu64(char *dst, uint64_t x)
+{
+	char buf[20], *p = buf + sizeof(buf);
+	do
+		*--p = (char)('0' + x % 10);
+	while ((x /= 10) != 0);
+
+	size_t n = (size_t)(buf + sizeof(buf) - p);
+	memcpy(dst, p, n);
+	return dst + n;
+}
+
+char *
+fmtbin(char *dst, const record_t *r, int flags)
+{
+	uint32_t v;
+	uint64_t w;
+
+	if (flags & BINID) {
+		w = htole64(r->f.id != NULL ? codetab_id(r->f.id, r->f.idn) : 0);
+		memcpy(dst, &w, sizeof(w));
+		dst += sizeof(w);
+	}
+	if (flags & BINCTR) {
+		w = htole64(r->ctr);
+		memcpy(dst, &w, sizeof(w));
+		dst += sizeof(w);
+	}
+
+	v = htole32(flags & BINTRUNC ? r->trunc : r->code);
+	memcpy(dst, &v, sizeof(v));
+	dst += sizeof(v);
+
+	if (flags & (BINCTR | BINID)) {
+		memset(dst, 0, sizeof(v));
+		dst += sizeof(v);
+	}
+	return dst;
+}
+
+char *
+fmtjson(char *dst, const char *s, size_t n)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	for (size_t i = 0; i < n; i++) {
+		uint8_t c = (uint8_t)s[i];
+		if (c == '"' || c == '\\') {
+			*dst++ = '\\';
+			*dst++ = (char)c;
+		} else if (c < 0x20) {
+			memcpy(dst, "\\u00", 4);
+			dst[4] = hex[c >> 4];
+			dst[5] = hex[c & 0xF];
+			dst += 6;
+		} else
+			*dst++ = (char)c;
+	}
+	return dst;
+}
+
+char *
+fmtcsv(char *dst, const char *s, size_t n)
+{
+	bool quote = false;
+	for (size_t i = 0; i < n && !quote; i++)
+		quote = s[i] == ',' || s[i] == '"' || s[i] == '\r' || s[i] == '\n';
+	if (!quote) {
+		memcpy(dst, s, n);
+		return dst + n;
+	}
+
+	*dst++ = '"';
+	for (size_t i = 0; i < n; i++) {
+		if (s[i] == '"')
+			*dst++ = '"';
+		*dst++ = s[i];
+	}
+	*dst++ = '"';
+	return dst;
+}
@@ -0,0 +1,115 @@
+#ifndef TOTP_FMT_H
+#define TOTP_FMT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dedup.h"
+#include "totp.h"
+
+/* The most bytes fmtrecord() writes for a record with an ID of length
+   IDN.  JSON escapes expand a byte to at most 6. */
+#define FMTMAX    (96)
+#define FMTSZ(idn) (FMTMAX + 6 * (idn))
+
+/* Output formats */
+enum {
+	FMTTEXT,
+	FMTJSON,
+	FMTCSV,
+	FMTBIN,
+};
+
+/* The binary output format is a header followed by one fixed-size
+   record per input line.  All integers are little-endian.  A record
+   contains, in order:
+
+       - the 64-bit hash of the line’s ID if BINID is set, computed as
+         by codetab_id();
+       - the 64-bit HOTP counter (time step) if BINCTR is set;
+       - the 32-bit code, or the 31-bit dynamically truncated HOTP value
+         if BINTRUNC is set;
+       - 32 bits of zero padding if either 64-bit field is present, so
+         that records stay 8-byte aligned. */
+
+/* The code stored in the record of an invalid line */
+#define BINBAD     UINT32_MAX
+
+#define BINMAGIC   "TOTPBIN"
+#define BINVERSION (1)
+
+enum {
+	BINTRUNC = 1 << 0,
+	BINCTR   = 1 << 1,
+	BINID    = 1 << 2,
+};
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t recsz;
+	uint32_t digits;
+	uint32_t period;
+	uint32_t pad;
+} binhdr_t;
+
+/* Reasons a record is rejected, continuing on from the KEY* codes */
+enum {
+	RECNOSEC = KEYINVAL + 1,
+	RECDIGITS,
+	RECPERIOD,
+	RECALGO,
+	RECURI,
+	RECHOTP,
+	RECMIG,
+	RECVAULT,
+	RECCRYPT,
+	RECTYPE,
+};
+
+/* What to do with invalid lines */
+enum {
+	ERRABORT,
+	ERRMARK,
+	ERRSKIP,
+};
+
+typedef struct {
+	int digits, period, format, binflags, onerr;
+	bool remaining, tagged, uri, lax;
+	uint64_t now;
+
+	/* Entries in each thread’s dedup table, or 0 to not deduplicate */
+	size_t dedup;
+} fmtcfg_t;
+
+/* The fields of an input line.  ID and SEC point into the line.  HOTP
+   and COUNTER are only ever set by an otpauth://hotp/ URI. */
+typedef struct {
+	const char *id, *sec;
+	size_t idn, secn;
+	int digits, period;
+	bool hotp;
+	uint64_t counter;
+} fields_t;
+
+typedef struct {
+	fields_t f;
+	uint32_t trunc, code;
+	uint64_t ctr, left;
+} record_t;
+
+int parsefields(fields_t *, const char *, size_t, const fmtcfg_t *);
+int mkrecord(record_t *, const char *, size_t, const fmtcfg_t *, dedup_t *);
+void mkcode(record_t *, const hmac_sha1_key_t *, const fmtcfg_t *);
+char *fmtrecord(char *, const record_t *, const fmtcfg_t *);
+char *fmtline(char *restrict, const char *restrict, size_t, const fmtcfg_t *,
+              dedup_t *, int *);
+char *fmtbad(char *, const char *, size_t, const fmtcfg_t *);
+char *fmtcode(char *, uint32_t, int);
+size_t fmthdr(char *, const fmtcfg_t *);
+const char *fmtstrerror(int);
+
+#endif /* !TOTP_FMT_H */
@@ -0,0 +1,254 @@
+#include <ctype.h>
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base32.h"
+#include "gen.h"
+#include "qr.h"
+#include "rng.h"
+#include "uri.h"
+
+/* Secrets drawn and encoded at once */
+#define BATCH (256)
+
+/* Output is flushed once this much is buffered */
+#define OUTSZ (64 * 1024)
+
+#define TOTPPREFIX URIPREFIX "totp/"
+
+/* Stands in for the number in a compiled template */
+#define SLOT '\1'
+
+/* The most digits of a size_t */
+#define NUMMAX (20)
+
+/* Encoding a whole batch in one atob32() call and slicing the result
+   only works if every key is a whole number of 5-byte blocks */
+_Static_assert(GENKEYSZ % 5 == 0, "GENKEYSZ must be a multiple of 5");
+
+static char *compile(const char *, bool, size_t *);
+static char *expand(char *, const char *, size_t);
+static char *utoa(char *, size_t);
+static char *put(char *, const char *, size_t);
+static void writeqr(const char *, size_t, int, const char *, size_t);
+
+/* Print N fresh random secrets one per line, either plain or as
+   otpauth:// URIs, as described by CFG.  QR codes imply URIs; written to
+   the standard output they replace the lines, except for text ones which
+   follow them. */
+void
+generate(size_t n, const gencfg_t *cfg)
+{
+	bool uri = cfg->uri || cfg->qr != QRNONE;
+	size_t tagmax = 0, namemax = 0, issmax = 0;
+	char *tag = cfg->tagged ? compile(cfg->name, false, &tagmax) : NULL,
+	     *name = uri ? compile(cfg->name, true, &namemax) : NULL,
+	     *iss = uri && cfg->issuer != NULL
+	          ? compile(cfg->issuer, true, &issmax) : NULL;
+
+	/* The longest line: the tag, the label, the parameters, and the
+	   numbers in them */
+	size_t linemax = tagmax + namemax + 2 * issmax + B32LEN(GENKEYSZ)
+	               + sizeof(TOTPPREFIX ":\t?secret=&issuer=&digits=&period=\n")
+	               + 2 * NUMMAX;
+	char *buf = malloc(OUTSZ + linemax), *p = buf;
+	if (buf == NULL)
+		err(1, "malloc");
+
+	/* One symbol and its output buffer serve for every code */
+	qr_t *qr = NULL;
+	if (cfg->qr != QRNONE) {
+		if ((qr = malloc(sizeof(*qr))) == NULL)
+			err(1, "malloc");
+		qr_init(qr);
+	}
+
+	rng_t rng;
+	rng_init(&rng);
+	uint8_t keys[BATCH * GENKEYSZ];
+	char secs[BATCH * B32LEN(GENKEYSZ)];
+
+	for (size_t i = 0; i < n;) {
+		size_t m = n - i < BATCH ? n - i : BATCH;
+		rng_fill(&rng, keys, m * GENKEYSZ);
+		atob32(secs, keys, m * GENKEYSZ);
+
+		for (size_t k = 0; k < m; k++) {
+			size_t num = ++i;
+			char *line = p, *u;
+			if (tag != NULL) {
+				p = expand(p, tag, num);
+				*p++ = '\t';
+			}
+			u = p;
+			if (name != NULL) {
+				p = put(p, TOTPPREFIX, sizeof(TOTPPREFIX) - 1);
+				if (iss != NULL) {
+					p = expand(p, iss, num);
+					*p++ = ':';
+				}
+				p = expand(p, name, num);
+				p = put(p, "?secret=", 8);
+			}
+			p = put(p, secs + k * B32LEN(GENKEYSZ), B32LEN(GENKEYSZ));
+			if (name != NULL) {
+				if (iss != NULL) {
+					p = put(p, "&issuer=", 8);
+					p = expand(p, iss, num);
+				}
+				if (cfg->digits != 6) {
+					p = put(p, "&digits=", 8);
+					p = utoa(p, (size_t)cfg->digits);
+				}
+				if (cfg->period != 30) {
+					p = put(p, "&period=", 8);
+					p = utoa(p, (size_t)cfg->period);
+				}
+			}
+
+			if (qr != NULL) {
+				if (!qr_encode(qr, (uint8_t *)u, (size_t)(p - u),
+				               cfg->qrecc))
+				{
+					errx(1, "URI too long for a QR code");
+				}
+				size_t len;
+				const char *img = qr_render(qr, cfg->qr, &len);
+				if (cfg->qrdir != NULL)
+					writeqr(cfg->qrdir, num, cfg->qr, img, len);
+				else {
+					if (cfg->qr != QRTEXT)
+						p = line;
+					else
+						*p++ = '\n';
+					fwrite(buf, 1, (size_t)(p - buf), stdout);
+					fwrite(img, 1, len, stdout);
+					p = buf;
+					continue;
+				}
+			}
+			*p++ = '\n';
+
+			if (p - buf >= OUTSZ) {
+				fwrite(buf, 1, (size_t)(p - buf), stdout);
+				p = buf;
+			}
+		}
+	}
+	fwrite(buf, 1, (size_t)(p - buf), stdout);
+
+	explicit_bzero(keys, sizeof(keys));
+	explicit_bzero(secs, sizeof(secs));
+	explicit_bzero(buf, OUTSZ + linemax);
+	if (qr != NULL) {
+		explicit_bzero(qr->out, qr->outcap);
+		explicit_bzero(qr, offsetof(qr_t, out));
+		qr_free(qr);
+		free(qr);
+	}
+	rng_free(&rng);
+	free(buf);
+	free(tag);
+	free(name);
+	free(iss);
+}
+
+/* Compile the template T for expand(), percent-encoding it if ESC is
+   true, and set *MAX to the most bytes its expansion can take.  Without
+   ESC the result is a tag, which may not contain control characters. */
+char *
+compile(const char *t, bool esc, size_t *max)
+{
+	char *s = malloc(strlen(t) * 3 + 1), *p = s;
+	if (s == NULL)
+		err(1, "malloc");
+
+	*max = 0;
+	for (const char *q = t; *q != 0; q++) {
+		if (q[0] == '%' && q[1] == 'n') {
+			*p++ = SLOT;
+			*max += NUMMAX;
+			q++;
+			continue;
+		}
+		if (q[0] == '%' && *++q != '%')
+			errx(1, "%s: invalid template", t);
+		if (!esc && iscntrl((unsigned char)*q))
+			errx(1, "%s: invalid template", t);
+
+		size_t n = esc ? uri_escape(p, q, 1) : (*p = *q, 1);
+		p += n;
+		*max += n;
+	}
+	*p = 0;
+	return s;
+}
+
+char *
+expand(char *dst, const char *t, size_t num)
+{
+	for (; *t != 0; t++) {
+		if (*t == SLOT)
+			dst = utoa(dst, num);
+		else
+			*dst++ = *t;
+	}
+	return dst;
+}
+
+char *
+utoa(char *dst, size_t x)
+{
+	char buf[NUMMAX], *p = buf + sizeof(buf);
+	do
+		*--p = (char)('0' + x % 10);
+	while (x /= 10);
+	return put(dst, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+char *
+put(char *dst, const char *s, size_t n)
+{
+	memcpy(dst, s, n);
+	return dst + n;
+}
+
+/* Write the N bytes of the QR code IMG in the format FMT for secret NUM
+   to its own file in DIR.  The code holds the secret, so the file is
+   readable only by its owner. */
+void
+writeqr(const char *dir, size_t num, int fmt, const char *img, size_t n)
+{
+	static const char *const exts[] = {
+		[QRTEXT] = "txt",
+		[QRSVG]  = "svg",
+		[QRPBM]  = "pbm",
+		[QRPNG]  = "png",
+	};
+
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), "%s/%zu.%s", dir, num, exts[fmt])
+	    >= (int)sizeof(path))
+	{
+		errx(1, "%s: directory name too long", dir);
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	while (n > 0) {
+		ssize_t m = write(fd, img, n);
+		if (m == -1)
+			err(1, "write: %s", path);
+		img += m;
+		n -= (size_t)m;
+	}
+	if (close(fd) == -1)
+		err(1, "close: %s", path);
+}
@@ -0,0 +1,23 @@
+#ifndef TOTP_GEN_H
+#define TOTP_GEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Bytes of every generated secret; the 160 bits RFC 4226 recommends */
+#define GENKEYSZ (20)
+
+/* NAME and ISSUER are templates in which ‘%n’ stands for the 1-based
+   number of the secret and ‘%%’ for a literal ‘%’.  ISSUER may be
+   NULL.  Unless QR is QRNONE every URI is also rendered as a QR code at
+   the error correction level QRECC, into the directory QRDIR if it
+   isn’t NULL and to the standard output otherwise. */
+typedef struct {
+	const char *name, *issuer, *qrdir;
+	int digits, period, qr, qrecc;
+	bool tagged, uri;
+} gencfg_t;
+
+void generate(size_t, const gencfg_t *);
+
+#endif /* !TOTP_GEN_H */
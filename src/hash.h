@@ -0,0 +1,30 @@
+#ifndef TOTP_HASH_H
+#define TOTP_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/* The 64-bit FNV-1a offset basis and prime */
+#define FNVBASIS (0xCBF29CE484222325ULL)
+#define FNVPRIME (0x100000001B3ULL)
+
+static inline uint64_t fnv1a(uint64_t, const void *, size_t)
+	__attribute__((always_inline, pure));
+
+/* Continue the FNV-1a hash H, which starts out as FNVBASIS, over the N
+   bytes at P.  It is defined here so that it can be inlined into the
+   lookups built on it. */
+uint64_t
+fnv1a(uint64_t h, const void *p, size_t n)
+{
+	const uint8_t *s = p;
+	for (size_t i = 0; i < n; i++) {
+		h ^= s[i];
+		h *= FNVPRIME;
+	}
+	return h;
+}
+
+#endif /* !TOTP_HASH_H */
@@ -1,6 +1,8 @@
 #include <string.h>
 
+#include "hmac.h"
 #include "sha1.h"
+#include "xendian.h"
 
 #define IPAD (0x36)
 #define OPAD (0x5C)
@@ -10,9 +12,16 @@ hmac_sha1(uint8_t *restrict out,
           const uint8_t *restrict key, size_t keysz,
           const uint8_t *restrict msg, size_t msgsz)
 {
-	uint8_t keyext[SHA1BLKSZ] = {0},
-	        keyipad[SHA1BLKSZ],
-	        keyopad[SHA1BLKSZ];
+	hmac_sha1_key_t k;
+	hmac_sha1key(&k, key, keysz);
+	hmac_sha1mid(out, &k, msg, msgsz);
+}
+
+void
+hmac_sha1key(hmac_sha1_key_t *restrict k,
+             const uint8_t *restrict key, size_t keysz)
+{
+	uint8_t keyext[SHA1BLKSZ] = {0};
 
 	if (keysz > SHA1BLKSZ) {
 		sha1_t sha;
@@ -22,20 +31,99 @@ hmac_sha1(uint8_t *restrict out,
 	} else
 		memcpy(keyext, key, keysz);
 
-	for (size_t i = 0; i < sizeof(keyext); i++) {
+	hmac_sha1keyblk(k, keyext);
+}
+
+/* Like hmac_sha1key() but for a key that has already been padded with
+   zeros to the block size */
+void
+hmac_sha1keyblk(hmac_sha1_key_t *restrict k,
+                const uint8_t keyext[restrict static SHA1BLKSZ])
+{
+	uint8_t keyipad[SHA1BLKSZ], keyopad[SHA1BLKSZ];
+
+	for (size_t i = 0; i < SHA1BLKSZ; i++) {
 		keyipad[i] = keyext[i] ^ IPAD;
 		keyopad[i] = keyext[i] ^ OPAD;
 	}
 
+	/* Each pad is exactly one block, so after hashing it the buffer is
+	   empty and the digest words are the full midstate. */
 	sha1_t sha;
-	uint8_t dgst[SHA1DGSTSZ];
 	sha1init(&sha);
 	sha1hash(&sha, keyipad, sizeof(keyipad));
-	sha1hash(&sha, msg, msgsz);
-	sha1end(&sha, dgst);
+	memcpy(k->ipad, sha.dgst, sizeof(k->ipad));
 
 	sha1init(&sha);
 	sha1hash(&sha, keyopad, sizeof(keyopad));
+	memcpy(k->opad, sha.dgst, sizeof(k->opad));
+}
+
+void
+hmac_sha1mid(uint8_t *restrict out, const hmac_sha1_key_t *restrict k,
+             const uint8_t *restrict msg, size_t msgsz)
+{
+	sha1_t sha;
+	uint8_t dgst[SHA1DGSTSZ];
+
+	memcpy(sha.dgst, k->ipad, sizeof(sha.dgst));
+	sha.msgsz = SHA1BLKSZ * 8;
+	sha.bufsz = 0;
+	sha1hash(&sha, msg, msgsz);
+	sha1end(&sha, dgst);
+
+	memcpy(sha.dgst, k->opad, sizeof(sha.dgst));
+	sha.msgsz = SHA1BLKSZ * 8;
+	sha.bufsz = 0;
 	sha1hash(&sha, dgst, sizeof(dgst));
 	sha1end(&sha, out);
 }
+
+/* Derive N bytes into DST from the password PASS and SALT with
+   PBKDF2-HMAC-SHA1 (RFC 8018 section 5.2) and ITERS iterations.  The
+   password’s midstates are computed once, so each iteration costs only
+   the two compressions of hmac_sha1mid(). */
+void
+hmac_sha1pbkdf2(uint8_t *restrict dst, size_t n,
+                const uint8_t *restrict pass, size_t passsz,
+                const uint8_t *restrict salt, size_t saltsz, uint32_t iters)
+{
+	hmac_sha1_key_t k;
+	hmac_sha1key(&k, pass, passsz);
+
+	for (uint32_t blk = 1; n > 0; blk++) {
+		sha1_t sha;
+		uint8_t u[2][SHA1DGSTSZ], t[SHA1DGSTSZ];
+		uint32_t be = htobe32(blk);
+
+		/* U₁ = PRF(P, S ‖ INT(i)) */
+		memcpy(sha.dgst, k.ipad, sizeof(sha.dgst));
+		sha.msgsz = SHA1BLKSZ * 8;
+		sha.bufsz = 0;
+		sha1hash(&sha, salt, saltsz);
+		sha1hash(&sha, (uint8_t *)&be, sizeof(be));
+		sha1end(&sha, t);
+		memcpy(sha.dgst, k.opad, sizeof(sha.dgst));
+		sha.msgsz = SHA1BLKSZ * 8;
+		sha.bufsz = 0;
+		sha1hash(&sha, t, sizeof(t));
+		sha1end(&sha, u[0]);
+		memcpy(t, u[0], sizeof(t));
+
+		for (uint32_t i = 1; i < iters; i++) {
+			uint8_t *prev = u[(i - 1) & 1], *cur = u[i & 1];
+			hmac_sha1mid(cur, &k, prev, SHA1DGSTSZ);
+			for (size_t j = 0; j < SHA1DGSTSZ; j++)
+				t[j] ^= cur[j];
+		}
+
+		size_t m = n < SHA1DGSTSZ ? n : SHA1DGSTSZ;
+		memcpy(dst, t, m);
+		dst += m;
+		n -= m;
+		memset(u, 0, sizeof(u));
+		memset(t, 0, sizeof(t));
+	}
+
+	memset(&k, 0, sizeof(k));
+}
@@ -4,8 +4,27 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "sha1.h"
+
+/* The SHA-1 states after hashing the padded inner and outer keys.  These
+   depend only on the key, so callers generating many codes from the
+   same secret should compute them once with hmac_sha1key(). */
+typedef struct {
+	uint32_t ipad[SHA1DGSTSZ / sizeof(uint32_t)],
+	         opad[SHA1DGSTSZ / sizeof(uint32_t)];
+} hmac_sha1_key_t;
+
 void hmac_sha1(uint8_t *restrict,
                const uint8_t *restrict, size_t,
                const uint8_t *restrict, size_t);
+void hmac_sha1key(hmac_sha1_key_t *restrict,
+                  const uint8_t *restrict, size_t);
+void hmac_sha1keyblk(hmac_sha1_key_t *restrict,
+                     const uint8_t [restrict static SHA1BLKSZ]);
+void hmac_sha1mid(uint8_t *restrict, const hmac_sha1_key_t *restrict,
+                  const uint8_t *restrict, size_t);
+void hmac_sha1pbkdf2(uint8_t *restrict, size_t,
+                     const uint8_t *restrict, size_t,
+                     const uint8_t *restrict, size_t, uint32_t);
 
 #endif /* !TOTP_HMAC_H */
@@ -0,0 +1,40 @@
+#ifndef TOTP_IMPORT_H
+#define TOTP_IMPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest key, issuer, and name an importer keeps; longer issuers and
+   names are truncated */
+#define IMPKEYMAX (256)
+#define IMPSTRMAX (256)
+
+/* An account read from an export of another authenticator.  The key is
+   either raw bytes in KEY or a base32 string in SEC.  A DIGITS or PERIOD
+   of 0 means the export didn’t say.  If ERR is not KEYOK the account is
+   unusable and ERR is the reason why. */
+typedef struct {
+	const uint8_t *key;
+	const char *sec, *issuer, *name;
+	size_t keysz, secn, issuern, namen;
+	int digits, period, err;
+	bool hotp;
+	uint64_t counter;
+} imacct_t;
+
+/* Export formats */
+enum {
+	IMPNONE,
+	IMPGOOGLE,
+	IMPAEGIS,
+	IMPANDOTP,
+};
+
+typedef void imfn_t(const imacct_t *, void *);
+
+int import_google(const char *, size_t, imfn_t *, void *);
+int import_aegis(const char *, size_t, imfn_t *, void *);
+int import_andotp(const char *, size_t, imfn_t *, void *);
+
+#endif /* !TOTP_IMPORT_H */
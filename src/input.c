@@ -0,0 +1,168 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "input.h"
+
+/* Initial size of the read buffer.  It only grows if a single line
+   doesn’t fit. */
+#define BUFSZ (1 << 20)
+
+static const char *lines(const char *, const char *,
+                         void (*)(const char *, size_t));
+
+/* Call FN on every line read from FD.  The input is read in large
+   blocks into a reusable buffer and split in place, so lines are never
+   copied.  Lines are handed off as soon as the read returning them
+   completes, which keeps this usable for interactive input. */
+void
+input_fd(int fd, void (*fn)(const char *, size_t))
+{
+	size_t cap = BUFSZ, len = 0;
+	char *buf = malloc(cap);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	for (;;) {
+		if (len == cap) {
+			cap *= 2;
+			if ((buf = realloc(buf, cap)) == NULL)
+				err(1, "realloc");
+		}
+
+		ssize_t nr = read(fd, buf + len, cap - len);
+		if (nr == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "read");
+		}
+		if (nr == 0)
+			break;
+
+		/* Only scan the newly read bytes for the first newline; the
+		   rest of the buffer is known not to contain one */
+		const char *end = buf + len + nr;
+		const char *nl = memchr(buf + len, '\n', (size_t)nr);
+		len += (size_t)nr;
+		if (nl == NULL)
+			continue;
+
+		const char *rest = lines(buf, end, fn);
+		len = (size_t)(end - rest);
+		memmove(buf, rest, len);
+	}
+
+	if (len != 0)
+		fn(buf, len);
+	free(buf);
+}
+
+/* Call FN on every line of the file at PATH.  Regular files are mapped
+   into memory and split in place; anything else is read as a stream. */
+void
+input_file(const char *path, void (*fn)(const char *, size_t))
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	if (fstat(fd, &st) == -1)
+		err(1, "fstat: %s", path);
+
+	if (!S_ISREG(st.st_mode)) {
+		input_fd(fd, fn);
+		close(fd);
+		return;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	size_t sz = (size_t)st.st_size;
+	char *map = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		err(1, "mmap: %s", path);
+	close(fd);
+#ifdef MADV_SEQUENTIAL
+	madvise(map, sz, MADV_SEQUENTIAL);
+#endif
+
+	const char *rest = lines(map, map + sz, fn);
+	if (rest != map + sz)
+		fn(rest, (size_t)(map + sz - rest));
+
+	munmap(map, sz);
+}
+
+/* Load the entire contents of FD into memory.  Regular files are
+   mapped; anything else is read until end-of-file. */
+void
+input_load(input_buf_t *b, int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		err(1, "fstat");
+
+	b->n = 0;
+	if (S_ISREG(st.st_mode) && st.st_size != 0) {
+		b->n = (size_t)st.st_size;
+		b->p = mmap(NULL, b->n, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (b->p == MAP_FAILED)
+			err(1, "mmap");
+		b->mapped = true;
+		return;
+	}
+
+	size_t cap = BUFSZ;
+	if ((b->p = malloc(cap)) == NULL)
+		err(1, "malloc");
+	b->mapped = false;
+
+	for (;;) {
+		if (b->n == cap) {
+			cap *= 2;
+			if ((b->p = realloc(b->p, cap)) == NULL)
+				err(1, "realloc");
+		}
+		ssize_t nr = read(fd, b->p + b->n, cap - b->n);
+		if (nr == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "read");
+		}
+		if (nr == 0)
+			break;
+		b->n += (size_t)nr;
+	}
+}
+
+void
+input_release(input_buf_t *b)
+{
+	if (b->mapped)
+		munmap(b->p, b->n);
+	else
+		free(b->p);
+}
+
+/* Call FN on every newline-terminated line in [P, END) and return a
+   pointer to the unterminated remainder.  memchr() is vectorized by
+   every libc we care about, so this runs at memory bandwidth. */
+const char *
+lines(const char *p, const char *end, void (*fn)(const char *, size_t))
+{
+	const char *nl;
+	while ((nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+		fn(p, (size_t)(nl - p));
+		p = nl + 1;
+	}
+	return p;
+}
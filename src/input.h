@@ -0,0 +1,18 @@
+#ifndef TOTP_INPUT_H
+#define TOTP_INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	char *p;
+	size_t n;
+	bool mapped;
+} input_buf_t;
+
+void input_fd(int, void (*)(const char *, size_t));
+void input_file(const char *, void (*)(const char *, size_t));
+void input_load(input_buf_t *, int);
+void input_release(input_buf_t *);
+
+#endif /* !TOTP_INPUT_H */
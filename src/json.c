@@ -0,0 +1,230 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "json.h"
+#include "uri.h"
+
+static inline bool isws(char)
+	__attribute__((always_inline, const));
+static bool getu16(const char *, const char *, uint32_t *);
+static size_t utf8(char *, uint32_t);
+
+/* Read the next token of J into T and return its type.  Strings and
+   numbers point into the document and nothing is copied. */
+int
+json_next(json_t *j, jsontok_t *t)
+{
+	while (j->p < j->end && (isws(*j->p) || *j->p == ',' || *j->p == ':'))
+		j->p++;
+	if (j->p == j->end)
+		return t->type = JSONEOF;
+
+	const char *p = j->p++;
+	t->s = p;
+	t->n = 1;
+	t->esc = false;
+
+	switch (*p) {
+	case '{':
+		return t->type = JSONOBJ;
+	case '}':
+		return t->type = JSONOBJEND;
+	case '[':
+		return t->type = JSONARR;
+	case ']':
+		return t->type = JSONARREND;
+	case '"':
+		/* Find the closing quote, stepping over escaped ones */
+		for (const char *q = j->p;; q++) {
+			if ((q = memchr(q, '"', (size_t)(j->end - q))) == NULL)
+				return t->type = JSONERR;
+
+			const char *b = q;
+			while (b > j->p && b[-1] == '\\')
+				b--;
+			if ((q - b) % 2 == 0) {
+				t->s = j->p;
+				t->n = (size_t)(q - j->p);
+				t->esc = memchr(t->s, '\\', t->n) != NULL;
+				j->p = q + 1;
+				return t->type = JSONSTR;
+			}
+		}
+	case 't':
+		if (j->end - p >= 4 && memcmp(p, "true", 4) == 0) {
+			j->p = p + 4;
+			return t->type = JSONTRUE;
+		}
+		return t->type = JSONERR;
+	case 'f':
+		if (j->end - p >= 5 && memcmp(p, "false", 5) == 0) {
+			j->p = p + 5;
+			return t->type = JSONFALSE;
+		}
+		return t->type = JSONERR;
+	case 'n':
+		if (j->end - p >= 4 && memcmp(p, "null", 4) == 0) {
+			j->p = p + 4;
+			return t->type = JSONNULL;
+		}
+		return t->type = JSONERR;
+	}
+
+	if (*p != '-' && (*p < '0' || *p > '9'))
+		return t->type = JSONERR;
+	while (j->p < j->end && (*j->p == '-' || *j->p == '+' || *j->p == '.'
+	                         || *j->p == 'e' || *j->p == 'E'
+	                         || (*j->p >= '0' && *j->p <= '9')))
+	{
+		j->p++;
+	}
+	t->n = (size_t)(j->p - p);
+	return t->type = JSONNUM;
+}
+
+/* Skip over the rest of the value that begins with the token T */
+bool
+json_skip(json_t *j, const jsontok_t *t)
+{
+	if (t->type != JSONOBJ && t->type != JSONARR)
+		return t->type > JSONEOF;
+
+	jsontok_t u;
+	for (size_t depth = 1; depth > 0;) {
+		switch (json_next(j, &u)) {
+		case JSONERR:
+		case JSONEOF:
+			return false;
+		case JSONOBJ:
+		case JSONARR:
+			depth++;
+			break;
+		case JSONOBJEND:
+		case JSONARREND:
+			depth--;
+			break;
+		}
+	}
+	return true;
+}
+
+/* Return whether the string token T is the ASCII string S ignoring
+   case */
+bool
+json_eq(const jsontok_t *t, const char *s)
+{
+	size_t n = strlen(s);
+	if (t->type != JSONSTR || t->n != n)
+		return false;
+	for (size_t i = 0; i < n; i++) {
+		char c = t->s[i];
+		char d = s[i];
+		if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c)
+		 != (d >= 'A' && d <= 'Z' ? d - 'A' + 'a' : d))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Decode the escapes in the N bytes of string contents at S into the
+   buffer DST of size CAP, truncating if needed, and return the length
+   of the result.  Invalid escapes are copied through as-is. */
+size_t
+json_unescape(char *dst, size_t cap, const char *s, size_t n)
+{
+	size_t len = 0;
+	const char *end = s + n;
+
+	while (s < end) {
+		char buf[4];
+		size_t m = 1;
+		buf[0] = *s++;
+
+		if (buf[0] == '\\' && s < end) {
+			uint32_t c, lo;
+			switch (*s++) {
+			case 'b':  buf[0] = '\b'; break;
+			case 'f':  buf[0] = '\f'; break;
+			case 'n':  buf[0] = '\n'; break;
+			case 'r':  buf[0] = '\r'; break;
+			case 't':  buf[0] = '\t'; break;
+			case 'u':
+				if (!getu16(s, end, &c)) {
+					buf[0] = '\\';
+					s--;
+					break;
+				}
+				s += 4;
+				/* Join surrogate pairs */
+				if (c >= 0xD800 && c < 0xDC00 && end - s >= 6
+				    && s[0] == '\\' && s[1] == 'u'
+				    && getu16(s + 2, end, &lo)
+				    && lo >= 0xDC00 && lo < 0xE000)
+				{
+					c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+					s += 6;
+				}
+				m = utf8(buf, c);
+				break;
+			default:
+				buf[0] = s[-1];
+			}
+		}
+
+		if (cap - len < m)
+			break;
+		memcpy(dst + len, buf, m);
+		len += m;
+	}
+
+	return len;
+}
+
+bool
+getu16(const char *s, const char *end, uint32_t *c)
+{
+	if (end - s < 4)
+		return false;
+	*c = 0;
+	for (int i = 0; i < 4; i++) {
+		int x = uri_unhex(s[i]);
+		if (x == -1)
+			return false;
+		*c = *c << 4 | (uint32_t)x;
+	}
+	return true;
+}
+
+size_t
+utf8(char *dst, uint32_t c)
+{
+	if (c < 0x80) {
+		dst[0] = (char)c;
+		return 1;
+	}
+	if (c < 0x800) {
+		dst[0] = (char)(0xC0 | c >> 6);
+		dst[1] = (char)(0x80 | (c & 0x3F));
+		return 2;
+	}
+	if (c < 0x10000) {
+		dst[0] = (char)(0xE0 | c >> 12);
+		dst[1] = (char)(0x80 | (c >> 6 & 0x3F));
+		dst[2] = (char)(0x80 | (c & 0x3F));
+		return 3;
+	}
+	dst[0] = (char)(0xF0 | c >> 18);
+	dst[1] = (char)(0x80 | (c >> 12 & 0x3F));
+	dst[2] = (char)(0x80 | (c >> 6 & 0x3F));
+	dst[3] = (char)(0x80 | (c & 0x3F));
+	return 4;
+}
+
+bool
+isws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
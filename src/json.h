@@ -0,0 +1,43 @@
+#ifndef TOTP_JSON_H
+#define TOTP_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A tokenizer that walks a JSON document in place.  Commas and colons
+   are skipped over rather than returned, so an object is just an
+   alternating sequence of keys and values. */
+
+enum {
+	JSONERR = -1,
+	JSONEOF,
+	JSONOBJ,
+	JSONOBJEND,
+	JSONARR,
+	JSONARREND,
+	JSONSTR,
+	JSONNUM,
+	JSONTRUE,
+	JSONFALSE,
+	JSONNULL,
+};
+
+typedef struct {
+	const char *p, *end;
+} json_t;
+
+/* S and N are the contents of a string without its quotes, or the text
+   of a number.  ESC is set if a string contains escapes. */
+typedef struct {
+	int type;
+	const char *s;
+	size_t n;
+	bool esc;
+} jsontok_t;
+
+int json_next(json_t *, jsontok_t *);
+bool json_skip(json_t *, const jsontok_t *);
+bool json_eq(const jsontok_t *, const char *);
+size_t json_unescape(char *, size_t, const char *, size_t);
+
+#endif /* !TOTP_JSON_H */
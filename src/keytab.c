@@ -0,0 +1,680 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acctab.h"
+#include "aead.h"
+#include "common.h"
+#include "hash.h"
+#include "hmac.h"
+#include "keytab.h"
+#include "poly1305.h"
+#include "rng.h"
+#include "totp.h"
+#include "xendian.h"
+
+/* Target number of labels per index partition */
+#define PARTKEYS (1 << 14)
+#define PBITSMAX (16)
+
+/* Average number of labels per bucket */
+#define BUCKETKEYS (4)
+
+/* Set in the displacement of a bucket holding a single label, whose
+   slot is stored directly */
+#define DIRECT (UINT32_C(1) << 31)
+
+/* The size of the index, padded so that the checksum covers it all */
+#define IDXSZ(np, nb, n) \
+	(((np) * sizeof(keytab_part_t) + (n) * sizeof(keytab_slot_t) \
+	  + (size_t)(nb) * sizeof(uint32_t) + 7) & ~(size_t)7)
+
+/* The sealed part of a record, and the associated data after it */
+#define SEALOFF (0)
+#define SEALSZ  offsetof(keytab_rec_t, period)
+#define AADOFF  offsetof(keytab_rec_t, period)
+#define AADSZ   (offsetof(keytab_rec_t, tag) - AADOFF)
+
+/* Give up on a bucket after this many displacements */
+#define DISPMAX (UINT32_C(1) << 24)
+
+_Static_assert(sizeof(keytab_hdr_t) == 128, "key table header size");
+_Static_assert(sizeof(keytab_rec_t) == 64, "key table record size");
+
+struct key {
+	uint64_t h;
+	uint32_t rec;
+};
+
+struct builder {
+	const struct key *keys;
+	const uint32_t *partoff;
+	const acctab_t *tab;
+	keytab_part_t *parts;
+	keytab_slot_t *slots;
+	uint32_t *disps;
+	uint32_t nparts;
+	atomic_uint next;
+};
+
+static void *build(void *);
+static void buildpart(struct builder *, uint32_t);
+static int bysize(const void *, const void *);
+static void seal(keytab_rec_t *, size_t, const uint8_t [static AEADKEYSZ]);
+static void hdrtag(uint8_t [static AEADTAGSZ],
+                   const uint8_t [static AEADKEYSZ], const keytab_hdr_t *,
+                   const uint8_t *, size_t);
+static void recnonce(uint8_t [static AEADNONCESZ], size_t);
+static void idkey(hmac_sha1_key_t *, const uint8_t [static AEADKEYSZ]);
+static uint64_t labelhash(const hmac_sha1_key_t *, const char *, size_t);
+static inline uint64_t mix(uint64_t)
+	__attribute__((always_inline, const));
+static inline uint32_t partof(uint64_t, int)
+	__attribute__((always_inline, const));
+static inline uint32_t bucketof(uint64_t, uint32_t)
+	__attribute__((always_inline, const));
+static inline uint32_t place(uint64_t, uint32_t, uint32_t)
+	__attribute__((always_inline, const));
+
+/* Write the accounts of TAB to the key table at PATH.  If INDEXED is
+   true the table is indexed by their labels, the index being built with
+   NTHREADS threads, or one per CPU if NTHREADS is 0.  If PASS is not NULL
+   the table is sealed with the passphrase PASS of length PASSSZ. */
+void
+keytab_write(const char *path, const acctab_t *tab, bool indexed,
+             int nthreads, const uint8_t *pass, size_t passsz)
+{
+	size_t n = tab->n;
+	if (n == 0)
+		errx(1, "%s: no accounts to write", path);
+	if (n >= DIRECT)
+		errx(1, "%s: too many accounts", path);
+
+	/* The key is needed up front, as it also keys the label hashes */
+	uint8_t salt[KEYTAB_SALTSZ] = {0}, key[AEADKEYSZ];
+	hmac_sha1_key_t ik, *ikp = NULL;
+	if (pass != NULL) {
+		rng_t rng;
+		rng_init(&rng);
+		rng_fill(&rng, salt, sizeof(salt));
+		rng_free(&rng);
+		hmac_sha1pbkdf2(key, sizeof(key), pass, passsz, salt, sizeof(salt),
+		                KEYTAB_KDFITERS);
+		idkey(ikp = &ik, key);
+	}
+
+	int pbits = 0;
+	uint32_t nparts = 0, nbuckets = 0;
+	if (indexed) {
+		while (pbits < PBITSMAX && n >> pbits > PARTKEYS)
+			pbits++;
+		nparts = UINT32_C(1) << pbits;
+	}
+
+	/* Hash the labels and sort them by partition */
+	struct key *keys = NULL;
+	uint32_t *partoff = NULL;
+	if (indexed) {
+		struct key *tmp = malloc(n * sizeof(*tmp));
+		keys = malloc(n * sizeof(*keys));
+		partoff = calloc(nparts + 1, sizeof(*partoff));
+		if (tmp == NULL || keys == NULL || partoff == NULL)
+			err(1, "malloc");
+
+		for (size_t i = 0; i < n; i++) {
+			const char *l = acctab_label(tab, i);
+			l = l != NULL ? l : "";
+			tmp[i].h = labelhash(ikp, l, strlen(l));
+			tmp[i].rec = (uint32_t)i;
+			partoff[partof(tmp[i].h, pbits) + 1]++;
+		}
+		for (uint32_t p = 0; p < nparts; p++) {
+			uint32_t np = partoff[p + 1];
+			partoff[p + 1] = partoff[p] + np;
+			nbuckets += (np + BUCKETKEYS - 1) / BUCKETKEYS;
+		}
+
+		uint32_t *fill = malloc(nparts * sizeof(*fill));
+		if (fill == NULL)
+			err(1, "malloc");
+		memcpy(fill, partoff, nparts * sizeof(*fill));
+		for (size_t i = 0; i < n; i++)
+			keys[fill[partof(tmp[i].h, pbits)]++] = tmp[i];
+		free(fill);
+		free(tmp);
+	}
+
+	size_t idxsz = nparts != 0 ? IDXSZ(nparts, nbuckets, n) : 0;
+	size_t bodysz = n * sizeof(keytab_rec_t) + idxsz;
+	size_t mapsz = sizeof(keytab_hdr_t) + bodysz;
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	if (ftruncate(fd, (off_t)mapsz) == -1)
+		err(1, "ftruncate: %s", path);
+	uint8_t *map = mmap(NULL, mapsz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		err(1, "mmap: %s", path);
+	close(fd);
+
+	/* The file was truncated, so the padding is already zero */
+	keytab_rec_t *recs = (keytab_rec_t *)(map + sizeof(keytab_hdr_t));
+	for (size_t i = 0; i < n; i++) {
+		keytab_rec_t *r = recs + i;
+		for (int j = 0; j < 5; j++) {
+			r->ipad[j] = htole32(tab->keys[i].ipad[j]);
+			r->opad[j] = htole32(tab->keys[i].opad[j]);
+		}
+		r->period = htole32(tab->periods[i]);
+		r->digits = tab->digits[i];
+		r->algo = KEYTAB_SHA1;
+	}
+
+	if (pass != NULL) {
+		for (size_t i = 0; i < n; i++)
+			seal(recs + i, i, key);
+	}
+
+	if (nparts != 0) {
+		struct builder b = {
+			.keys    = keys,
+			.partoff = partoff,
+			.tab     = tab,
+			.parts   = (keytab_part_t *)(recs + n),
+			.nparts  = nparts,
+		};
+		b.slots = (keytab_slot_t *)(b.parts + nparts);
+		b.disps = (uint32_t *)(b.slots + n);
+
+		uint32_t boff = 0;
+		for (uint32_t p = 0; p < nparts; p++) {
+			uint32_t np = partoff[p + 1] - partoff[p];
+			b.parts[p] = (keytab_part_t){
+				.slotoff   = partoff[p],
+				.nslots    = np,
+				.bucketoff = boff,
+				.nbuckets  = (np + BUCKETKEYS - 1) / BUCKETKEYS,
+			};
+			boff += b.parts[p].nbuckets;
+		}
+
+		if (nthreads <= 0)
+			nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads <= 0)
+			nthreads = 1;
+		if ((uint32_t)nthreads > nparts)
+			nthreads = (int)nparts;
+
+		pthread_t *thrds = calloc((size_t)nthreads, sizeof(*thrds));
+		if (thrds == NULL)
+			err(1, "calloc");
+		for (int i = 1; i < nthreads; i++) {
+			if ((errno = pthread_create(thrds + i, NULL, build, &b)) != 0)
+				err(1, "pthread_create");
+		}
+		build(&b);
+		for (int i = 1; i < nthreads; i++)
+			pthread_join(thrds[i], NULL);
+		free(thrds);
+
+		/* Only now that the builders are done with them */
+		for (uint32_t p = 0; p < nparts; p++) {
+			keytab_part_t *pt = b.parts + p;
+			pt->slotoff   = htole32(pt->slotoff);
+			pt->nslots    = htole32(pt->nslots);
+			pt->bucketoff = htole32(pt->bucketoff);
+			pt->nbuckets  = htole32(pt->nbuckets);
+		}
+	}
+
+	keytab_hdr_t hdr = {
+		.magic    = KEYTAB_MAGIC,
+		.version  = htole32(KEYTAB_VERSION),
+		.flags    = htole32(pass != NULL ? KEYTAB_SEALED : 0),
+		.nrecs    = htole64(n),
+		.sum      = htole64(keytab_sum((uint8_t *)recs, bodysz)),
+		.nparts   = htole32(nparts),
+		.nbuckets = htole32(nbuckets),
+		.kdfiters = htole32(pass != NULL ? KEYTAB_KDFITERS : 0),
+	};
+	if (pass != NULL) {
+		memcpy(hdr.salt, salt, sizeof(salt));
+		hdrtag(hdr.check, key, &hdr, (uint8_t *)(recs + n), idxsz);
+		memset(key, 0, sizeof(key));
+		memset(&ik, 0, sizeof(ik));
+	}
+	memcpy(map, &hdr, sizeof(hdr));
+
+	if (munmap(map, mapsz) == -1)
+		err(1, "munmap: %s", path);
+	free(keys);
+	free(partoff);
+}
+
+void *
+build(void *arg)
+{
+	struct builder *b = arg;
+	uint32_t p;
+	while ((p = atomic_fetch_add(&b->next, 1)) < b->nparts)
+		buildpart(b, p);
+	return NULL;
+}
+
+/* Build partition P of the index.  Buckets are placed largest first,
+   while the partition is still empty enough for them to find room: each
+   tries displacements in turn until all its labels land in free slots.
+   Buckets of a single label are placed last and simply take the next
+   free slot. */
+void
+buildpart(struct builder *b, uint32_t p)
+{
+	const keytab_part_t *pt = b->parts + p;
+	const struct key *keys = b->keys + b->partoff[p];
+	uint32_t ns = pt->nslots, nb = pt->nbuckets;
+	uint32_t *disps = b->disps + pt->bucketoff;
+	keytab_slot_t *slots = b->slots + pt->slotoff;
+	if (ns == 0)
+		return;
+
+	/* Group the keys by bucket */
+	uint32_t *start = calloc(nb + 1, sizeof(*start)),
+	         *order = malloc(nb * sizeof(*order)),
+	         *fill = malloc(nb * sizeof(*fill)),
+	         *byb = malloc(ns * sizeof(*byb)),
+	         *pos = malloc(ns * sizeof(*pos));
+	uint8_t *taken = calloc(ns, 1);
+	if (start == NULL || order == NULL || fill == NULL || byb == NULL
+	    || pos == NULL || taken == NULL)
+	{
+		err(1, "malloc");
+	}
+
+	for (uint32_t i = 0; i < ns; i++)
+		start[bucketof(keys[i].h, nb) + 1]++;
+	for (uint32_t i = 0; i < nb; i++)
+		start[i + 1] += start[i];
+	memcpy(fill, start, nb * sizeof(*fill));
+	for (uint32_t i = 0; i < ns; i++)
+		byb[fill[bucketof(keys[i].h, nb)]++] = i;
+
+	/* Sort the buckets largest first, packing each bucket’s size into
+	   the top byte of its number */
+	if (nb >= 1 << 24)
+		errx(1, "label index partition too large");
+	for (uint32_t i = 0; i < nb; i++) {
+		if (start[i + 1] - start[i] > 0xFF)
+			errx(1, "failed to build the label index");
+		order[i] = (start[i + 1] - start[i]) << 24 | i;
+	}
+	qsort(order, nb, sizeof(*order), bysize);
+
+	uint32_t next = 0;
+	for (uint32_t k = 0; k < nb; k++) {
+		uint32_t bk = order[k] & 0xFFFFFF, sz = order[k] >> 24;
+		const uint32_t *ks = byb + start[bk];
+
+		if (sz == 0)
+			disps[bk] = 0;
+		else if (sz == 1) {
+			while (taken[next])
+				next++;
+			taken[next] = 1;
+			disps[bk] = htole32(DIRECT | next);
+			slots[next] = (keytab_slot_t){
+				.id  = htole64(keys[ks[0]].h),
+				.rec = htole32(keys[ks[0]].rec),
+			};
+		} else {
+			for (uint32_t i = 0; i < sz; i++) {
+				for (uint32_t j = i + 1; j < sz; j++) {
+					if (keys[ks[i]].h == keys[ks[j]].h) {
+						const char *l = acctab_label(b->tab,
+						                             keys[ks[j]].rec);
+						errx(1, "%s: duplicate account label",
+						     l != NULL ? l : "");
+					}
+				}
+			}
+
+			uint32_t d;
+			for (d = 0; d < DISPMAX; d++) {
+				uint32_t i;
+				for (i = 0; i < sz; i++) {
+					pos[i] = place(keys[ks[i]].h, d, ns);
+					if (taken[pos[i]])
+						break;
+					taken[pos[i]] = 1;
+				}
+				if (i == sz)
+					break;
+				while (i-- > 0)
+					taken[pos[i]] = 0;
+			}
+			if (d == DISPMAX)
+				errx(1, "failed to build the label index");
+
+			disps[bk] = htole32(d);
+			for (uint32_t i = 0; i < sz; i++) {
+				slots[pos[i]] = (keytab_slot_t){
+					.id  = htole64(keys[ks[i]].h),
+					.rec = htole32(keys[ks[i]].rec),
+				};
+			}
+		}
+	}
+
+	free(start);
+	free(order);
+	free(fill);
+	free(byb);
+	free(pos);
+	free(taken);
+}
+
+int
+bysize(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x < y) - (x > y);
+}
+
+void
+keytab_open(keytab_t *t, const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	if (fstat(fd, &st) == -1)
+		err(1, "fstat: %s", path);
+	if ((size_t)st.st_size < sizeof(keytab_hdr_t))
+		errx(1, "%s: not a key table", path);
+
+	t->mapsz = (size_t)st.st_size;
+	t->map = mmap(NULL, t->mapsz, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (t->map == MAP_FAILED)
+		err(1, "mmap: %s", path);
+	close(fd);
+
+	const keytab_hdr_t *hdr = (const keytab_hdr_t *)t->map;
+	if (memcmp(hdr->magic, KEYTAB_MAGIC, sizeof(hdr->magic)) != 0)
+		errx(1, "%s: not a key table", path);
+	if (le32toh(hdr->version) != KEYTAB_VERSION)
+		errx(1, "%s: unsupported key table version %u", path,
+		     le32toh(hdr->version));
+
+	uint64_t n = le64toh(hdr->nrecs);
+	uint32_t np = le32toh(hdr->nparts), nb = le32toh(hdr->nbuckets);
+	size_t bodysz = t->mapsz - sizeof(*hdr);
+	if (n > bodysz / sizeof(keytab_rec_t) || n >= DIRECT
+	 || (np & (np - 1)) != 0 || np > UINT32_C(1) << PBITSMAX)
+	{
+		errx(1, "%s: corrupt key table", path);
+	}
+	size_t idxsz = np != 0 ? IDXSZ(np, nb, n) : 0;
+	if (bodysz != n * sizeof(keytab_rec_t) + idxsz)
+		errx(1, "%s: corrupt key table", path);
+
+	t->recs = (const keytab_rec_t *)(t->map + sizeof(*hdr));
+	t->nrecs = (size_t)n;
+	if (keytab_sum((const uint8_t *)t->recs, bodysz) != le64toh(hdr->sum))
+		errx(1, "%s: key table checksum mismatch", path);
+
+	t->nparts = np;
+	t->parts = (const keytab_part_t *)(t->recs + n);
+	t->slots = (const keytab_slot_t *)(t->parts + np);
+	t->disps = (const uint32_t *)(t->slots + n);
+	t->sealed = (le32toh(hdr->flags) & KEYTAB_SEALED) != 0;
+	if (t->sealed && (le32toh(hdr->kdfiters) == 0
+	               || le32toh(hdr->kdfiters) > KEYTAB_KDFMAX))
+	{
+		errx(1, "%s: corrupt key table", path);
+	}
+	for (t->pbits = 0; np >> t->pbits > 1; t->pbits++)
+		;
+	/* A partition has exactly the buckets keytab_write() gives it, so
+	   that keytab_find() never looks past them */
+	for (uint32_t p = 0; p < np; p++) {
+		const keytab_part_t *pt = t->parts + p;
+		uint32_t ns = le32toh(pt->nslots), pb = le32toh(pt->nbuckets);
+		if ((uint64_t)le32toh(pt->slotoff) + ns > n
+		 || (uint64_t)le32toh(pt->bucketoff) + pb > nb
+		 || pb != ((uint64_t)ns + BUCKETKEYS - 1) / BUCKETKEYS)
+		{
+			errx(1, "%s: corrupt key table", path);
+		}
+	}
+}
+
+/* Derive the key of the sealed table T from the passphrase PASS of
+   length PASSSZ.  Returns false if it is the wrong passphrase or the
+   header or index have been tampered with. */
+bool
+keytab_unseal(keytab_t *t, const uint8_t *pass, size_t passsz)
+{
+	const keytab_hdr_t *hdr = (const keytab_hdr_t *)t->map;
+	hmac_sha1pbkdf2(t->key, sizeof(t->key), pass, passsz, hdr->salt,
+	                sizeof(hdr->salt), le32toh(hdr->kdfiters));
+
+	uint8_t tag[AEADTAGSZ], diff = 0;
+	const uint8_t *idx = (const uint8_t *)(t->recs + t->nrecs);
+	hdrtag(tag, t->key, hdr, idx, (size_t)(t->map + t->mapsz - idx));
+	for (size_t i = 0; i < sizeof(tag); i++)
+		diff |= tag[i] ^ hdr->check[i];
+	if (diff != 0) {
+		memset(t->key, 0, sizeof(t->key));
+		return false;
+	}
+	idkey(&t->idkey, t->key);
+	return true;
+}
+
+void
+keytab_close(keytab_t *t)
+{
+	memset(t->key, 0, sizeof(t->key));
+	memset(&t->idkey, 0, sizeof(t->idkey));
+	munmap((void *)t->map, t->mapsz);
+}
+
+/* Load record I of T into A.  Returns false if there is no such record
+   or it describes an account we can’t generate codes for. */
+bool
+keytab_acct(const keytab_t *t, size_t i, account_t *a)
+{
+	if (i >= t->nrecs)
+		return false;
+
+	const keytab_rec_t *r = t->recs + i;
+	uint32_t period = le32toh(r->period), digits = r->digits;
+	if (r->algo != KEYTAB_SHA1 || digits == 0 || digits > 9
+	 || period == 0 || period > INT32_MAX)
+	{
+		return false;
+	}
+
+	/* Only this record is decrypted, and only onto the stack */
+	keytab_rec_t tmp;
+	if (t->sealed) {
+		uint8_t nonce[AEADNONCESZ];
+		recnonce(nonce, i);
+		if (!aead_open((uint8_t *)&tmp + SEALOFF, t->key, nonce,
+		               (const uint8_t *)r + AADOFF, AADSZ,
+		               (const uint8_t *)r + SEALOFF, SEALSZ, r->tag))
+		{
+			return false;
+		}
+		r = &tmp;
+	}
+
+	for (int j = 0; j < 5; j++) {
+		a->key.ipad[j] = le32toh(r->ipad[j]);
+		a->key.opad[j] = le32toh(r->opad[j]);
+	}
+	a->digits = (int)digits;
+	a->period = (int)period;
+	memset(&tmp, 0, SEALSZ);
+	return true;
+}
+
+/* Find the record of the account labelled S of length N in T.  Returns
+   false if there is none or T has no index. */
+bool
+keytab_find(const keytab_t *t, const char *s, size_t n, size_t *rec)
+{
+	if (t->nparts == 0)
+		return false;
+
+	uint64_t h = labelhash(t->sealed ? &t->idkey : NULL, s, n);
+	const keytab_part_t *pt = t->parts + partof(h, t->pbits);
+	uint32_t ns = le32toh(pt->nslots);
+	if (ns == 0)
+		return false;
+
+	uint32_t b = bucketof(h, le32toh(pt->nbuckets));
+	uint32_t d = le32toh(t->disps[le32toh(pt->bucketoff) + b]);
+	uint32_t slot = d & DIRECT ? d & ~DIRECT : place(h, d, ns);
+	if (slot >= ns)
+		return false;
+
+	const keytab_slot_t *sl = t->slots + le32toh(pt->slotoff) + slot;
+	uint32_t i = le32toh(sl->rec);
+	if (i >= t->nrecs || le64toh(sl->id) != h)
+		return false;
+	*rec = i;
+	return true;
+}
+
+/* Seal record I of a table, R, in place with KEY */
+void
+seal(keytab_rec_t *r, size_t i, const uint8_t key[static AEADKEYSZ])
+{
+	uint8_t nonce[AEADNONCESZ], pt[SEALSZ];
+	recnonce(nonce, i);
+	memcpy(pt, (uint8_t *)r + SEALOFF, SEALSZ);
+	aead_seal((uint8_t *)r + SEALOFF, r->tag, key, nonce,
+	          (uint8_t *)r + AADOFF, AADSZ, pt, SEALSZ);
+	memset(pt, 0, sizeof(pt));
+}
+
+/* Compute the CHECK tag of the header HDR and the IDXSZ bytes of index
+   at IDX.  Record numbers are below 2³¹, so the all-ones nonce is never
+   a record’s. */
+void
+hdrtag(uint8_t tag[static AEADTAGSZ], const uint8_t key[static AEADKEYSZ],
+       const keytab_hdr_t *hdr, const uint8_t *idx, size_t idxsz)
+{
+	uint8_t nonce[AEADNONCESZ], otk[CHACHABLKSZ];
+	memset(nonce, 0xFF, sizeof(nonce));
+	chacha20(otk, key, nonce, 0, 1);
+
+	poly1305_t p;
+	poly1305init(&p, otk);
+	poly1305hash(&p, (const uint8_t *)hdr, offsetof(keytab_hdr_t, check));
+	poly1305hash(&p, idx, idxsz);
+	poly1305end(&p, tag);
+	memset(otk, 0, sizeof(otk));
+}
+
+/* Records are sealed with their number as the nonce */
+void
+recnonce(uint8_t nonce[static AEADNONCESZ], size_t i)
+{
+	uint64_t x = htole64((uint64_t)i);
+	memcpy(nonce, &x, sizeof(x));
+	memset(nonce + sizeof(x), 0, AEADNONCESZ - sizeof(x));
+}
+
+/* Derive the key of the label hashes of a sealed table from its KEY,
+   as the second block of the keystream used by hdrtag() */
+void
+idkey(hmac_sha1_key_t *ik, const uint8_t key[static AEADKEYSZ])
+{
+	uint8_t nonce[AEADNONCESZ], blk[CHACHABLKSZ];
+	memset(nonce, 0xFF, sizeof(nonce));
+	chacha20(blk, key, nonce, 1, 1);
+	hmac_sha1key(ik, blk, AEADKEYSZ);
+	memset(blk, 0, sizeof(blk));
+}
+
+/* Hash the label S of length N for the index.  Labels are hashed with
+   keytab_hash() in plain tables, but in sealed tables with HMAC-SHA1
+   under IK, so that the index can’t be used to confirm guessed labels
+   without the passphrase. */
+uint64_t
+labelhash(const hmac_sha1_key_t *ik, const char *s, size_t n)
+{
+	if (ik == NULL)
+		return keytab_hash(s, n);
+
+	uint8_t dgst[SHA1DGSTSZ];
+	uint64_t h;
+	hmac_sha1mid(dgst, ik, (const uint8_t *)s, n);
+	memcpy(&h, dgst, sizeof(h));
+	return le64toh(h);
+}
+
+/* Hash an account label for the index: FNV-1a, with its weak high bits
+   mixed in so that they can pick the partition */
+uint64_t
+keytab_hash(const char *s, size_t n)
+{
+	return mix(fnv1a(FNVBASIS, s, n));
+}
+
+/* Checksum the N bytes at P, a multiple of 8, with FNV-1a taken a
+   little-endian 64-bit word at a time rather than a byte at a time, which
+   is plenty to catch a truncated or damaged file and fast enough to run
+   on every open */
+uint64_t
+keytab_sum(const uint8_t *p, size_t n)
+{
+	uint64_t h = FNVBASIS;
+	for (size_t i = 0; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+		uint64_t w;
+		memcpy(&w, p + i, sizeof(w));
+		h ^= le64toh(w);
+		h *= FNVPRIME;
+	}
+	return h;
+}
+
+/* The splitmix64 finalizer */
+uint64_t
+mix(uint64_t x)
+{
+	x = (x ^ x >> 30) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ x >> 27) * 0x94D049BB133111EBULL;
+	return x ^ x >> 31;
+}
+
+uint32_t
+partof(uint64_t h, int pbits)
+{
+	return pbits != 0 ? (uint32_t)(h >> (64 - pbits)) : 0;
+}
+
+uint32_t
+bucketof(uint64_t h, uint32_t nb)
+{
+	return (uint32_t)((h & UINT32_MAX) * nb >> 32);
+}
+
+/* The slot in a partition of NS slots of the label hashing to H under
+   the displacement D */
+uint32_t
+place(uint64_t h, uint32_t d, uint32_t ns)
+{
+	return (uint32_t)((mix(h ^ d * 0x9E3779B97F4A7C15ULL) >> 32) * ns >> 32);
+}
@@ -0,0 +1,141 @@
+#ifndef TOTP_KEYTAB_H
+#define TOTP_KEYTAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acctab.h"
+#include "aead.h"
+#include "totp.h"
+
+/* A key table holds accounts already reduced to their HMAC midstates,
+   so that codes can be generated without parsing or decoding anything.
+   All integers are little-endian.  The file consists of:
+
+       1. The header below, two cache lines long.
+       2. NRECS records of one cache line each, in input order.
+       3. If NPARTS is not 0, an index from account labels to records:
+          a. NPARTS partitions;
+          b. NRECS slots;
+          c. NBUCKETS 32-bit displacements, padded to a multiple of 8
+             bytes.
+
+   SUM is a checksum of everything after the header, computed as by
+   keytab_sum().
+
+   The index is a minimal perfect hash in the style of CHD (‘hash,
+   displace, and compress’).  A label is hashed with keytab_hash(); the
+   top bits of the hash pick a partition and the low 32 bits a bucket
+   within it.  The bucket’s displacement D then gives the label’s slot
+   in the partition: either D without its high bit if that is set, or
+   the hash remixed with D otherwise (see the source).  The slot holds
+   the hash of its label, which is compared to weed out labels not in
+   the table, and the record number.  A lookup thus touches one
+   displacement, one slot, and the record itself.  Partitions are
+   independent, so they are built in parallel.
+
+   If KEYTAB_SEALED is set in FLAGS the midstates of each record are
+   encrypted with ChaCha20-Poly1305 (RFC 8439) under a key derived from
+   a passphrase with PBKDF2-HMAC-SHA1, KDFITERS iterations, and SALT.
+   Each record is sealed on its own, with its record number as the
+   nonce and the rest of the record up to TAG as associated data, so
+   that using an account decrypts only its record.  CHECK is a Poly1305
+   tag over the header up to CHECK and the index, keyed by the first
+   block of the keystream for an all-ones nonce; it tells a wrong
+   passphrase from a damaged record and authenticates the index.  The
+   labels of a sealed table are hashed for the index with HMAC-SHA1
+   keyed by the first half of the second block of that keystream instead
+   of keytab_hash(), so that the index reveals nothing about them. */
+
+#define KEYTAB_MAGIC   "TOTPKTAB"
+#define KEYTAB_VERSION (1)
+
+/* Header flags */
+#define KEYTAB_SEALED (1 << 0)
+
+/* Defaults for sealed tables */
+#define KEYTAB_KDFITERS (1 << 18)
+#define KEYTAB_SALTSZ   (16)
+
+/* Most KDF iterations a table may ask for.  The count is read from the
+   file before anything authenticates it, so it is bounded to keep a
+   crafted table from stalling keytab_unseal(). */
+#define KEYTAB_KDFMAX (16 * KEYTAB_KDFITERS)
+
+/* Hash algorithms; SHA-1 is the only one implemented */
+enum {
+	KEYTAB_SHA1,
+};
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t nrecs;
+	uint64_t sum;
+	uint32_t nparts;
+	uint32_t nbuckets;
+	uint32_t kdfiters;
+	uint8_t salt[KEYTAB_SALTSZ];
+	uint8_t check[AEADTAGSZ];
+	uint8_t pad[52];
+} keytab_hdr_t;
+
+/* IPAD and OPAD are the words of the HMAC midstates of
+   hmac_sha1_key_t.  TAG is the Poly1305 tag of a sealed record, and
+   zero otherwise. */
+typedef struct {
+	uint32_t ipad[5], opad[5];
+	uint32_t period;
+	uint8_t digits, algo;
+	uint8_t pad[2];
+	uint8_t tag[AEADTAGSZ];
+} keytab_rec_t;
+
+/* A partition of the index covers the NSLOTS slots from SLOTOFF on and
+   the NBUCKETS displacements from BUCKETOFF on */
+typedef struct {
+	uint32_t slotoff, nslots;
+	uint32_t bucketoff, nbuckets;
+} keytab_part_t;
+
+/* ID is the hash of the label of record REC */
+typedef struct {
+	uint64_t id;
+	uint32_t rec;
+	uint32_t pad;
+} keytab_slot_t;
+
+typedef struct {
+	const uint8_t *map;
+	size_t mapsz;
+	const keytab_rec_t *recs;
+	size_t nrecs;
+
+	/* The index, if NPARTS is not 0 */
+	const keytab_part_t *parts;
+	const keytab_slot_t *slots;
+	const uint32_t *disps;
+	uint32_t nparts;
+	int pbits;
+
+	/* Set by keytab_unseal() for sealed tables */
+	bool sealed;
+	uint8_t key[AEADKEYSZ];
+	hmac_sha1_key_t idkey;
+} keytab_t;
+
+void keytab_write(const char *, const acctab_t *, bool, int,
+                  const uint8_t *, size_t);
+void keytab_open(keytab_t *, const char *);
+bool keytab_unseal(keytab_t *, const uint8_t *, size_t);
+void keytab_close(keytab_t *);
+bool keytab_acct(const keytab_t *, size_t, account_t *);
+bool keytab_find(const keytab_t *, const char *, size_t, size_t *);
+uint64_t keytab_hash(const char *, size_t)
+	__attribute__((pure));
+uint64_t keytab_sum(const uint8_t *, size_t)
+	__attribute__((pure));
+
+#endif /* !TOTP_KEYTAB_H */
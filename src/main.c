@@ -1,5 +1,6 @@
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <libgen.h>
@@ -12,28 +13,94 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "codeidx.h"
+#include "codetab.h"
+#include "acctab.h"
 #include "base32.h"
 #include "common.h"
+#include "dedup.h"
+#include "fmt.h"
+#include "gen.h"
 #include "hmac.h"
-#include "sha1.h"
-#include "xendian.h"
+#include "import.h"
+#include "input.h"
+#include "keytab.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "qr.h"
+#include "serve.h"
+#include "totp.h"
+#include "watch.h"
 
+/* Default number of entries in a dedup table */
+#define DDDEFAULT (4096)
+
+static void decode(hmac_sha1_key_t *, const char *, size_t);
+static noreturn void keyerr(int, const char *, size_t);
+static void lineerr(size_t, int, const char *, size_t);
 static void process(const char *, size_t);
-static void process_stdin(void);
-static inline uint32_t pow32(uint32_t, uint32_t)
-	__attribute__((always_inline, const));
+static void addacct(const char *, size_t);
+static void importline(const char *, size_t);
+static void importdoc(void);
+static void imported(const imacct_t *, void *);
+static size_t imid(char *, const imacct_t *);
+static void batch(void);
+static int match(const char *);
+static void mktable(const char *);
+static int check(const char *, char **);
+static int keycodes(const char *, char **, int);
+static void loadpass(const char *);
+static void droppass(void);
 static inline bool xisdigit(char)
 	__attribute__((always_inline, const));
 
-static int digits = 6, period = 30;
+static int digits = 6, jobs, ngen, period = 30, steps;
+static int iflag, qflag = QRNONE, Qflag = QRECCM;
+static bool Hflag, lflag, Pflag, rflag, sflag, tflag, uflag, wflag, xflag;
+static char *cflag, *Cflag, *eflag, *fflag, *Iflag, *Kflag, *mflag, *Nflag,
+            *Oflag, *Sflag, *Tflag;
+static fmtcfg_t cfg;
+
+static FILE *errf;
+static size_t lineno, nerrs;
+
+static dedup_t _dd, *dd;
+
+/* Importers for -i; Google exports are line-based and the rest are
+   whole JSON documents */
+static int (*const importers[])(const char *, size_t, imfn_t *, void *) = {
+	[IMPGOOGLE] = import_google,
+	[IMPAEGIS]  = import_aegis,
+	[IMPANDOTP] = import_andotp,
+};
+
+/* The passphrase from -S */
+static input_buf_t pass;
+static size_t passsz;
+
+/* The accounts collected for -C, -m, -T, and -w */
+static acctab_t accts;
 
 static noreturn void
 usage(const char *argv0)
 {
 	fprintf(stderr,
-		"Usage: %s [-d digits] [-p period] [secret ...]\n"
+		"Usage: %s [-b[fields]] [-D[entries]] [-d digits] [-e file] [-f file]\n"
+		"          [-i format] [-j jobs] [-k[skip]] [-o format] [-p period]\n"
+		"          [-HlPrtuwx] [secret ...]\n"
+		"       %s [-d digits] [-f file] [-p period] [-Hltu] -m code [secret ...]\n"
+		"       %s [-d digits] [-f file] [-p period] [-n steps] [-Hltu] -T file\n"
+		"          [secret ...]\n"
+		"       %s [-d digits] [-f file] [-p period] [-S file] [-Hltu] -C file\n"
+		"          [secret ...]\n"
+		"       %s [-b[fields]] [-o format] [-S file] [-rt] -K file\n"
+		"          [record ...]\n"
+		"       %s [-t] -c file account code\n"
+		"       %s [-d digits] [-p period] [-l] -s\n"
+		"       %s [-d digits] [-I issuer] [-N name] [-O dir] [-p period]\n"
+		"          [-Q level] [-q format] [-tu] -g count\n"
 		"       %s -h\n",
-		argv0, argv0);
+		argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
 	exit(EXIT_FAILURE);
 }
 
@@ -42,26 +109,192 @@ main(int argc, char **argv)
 {
 	int opt;
 	static const struct option longopts[] = {
-		{"digits", required_argument, 0, 'd'},
-		{"help",   no_argument,       0, 'h'},
-		{"period", required_argument, 0, 'p'},
+		{"binary",      optional_argument, 0, 'b'},
+		{"check",       required_argument, 0, 'c'},
+		{"compile",     required_argument, 0, 'C'},
+		{"dedup",       optional_argument, 0, 'D'},
+		{"digits",      required_argument, 0, 'd'},
+		{"errors",      required_argument, 0, 'e'},
+		{"export",      no_argument,       0, 'x'},
+		{"file",        required_argument, 0, 'f'},
+		{"format",      required_argument, 0, 'o'},
+		{"generate",    required_argument, 0, 'g'},
+		{"help",        no_argument,       0, 'h'},
+		{"huge-pages",  no_argument,       0, 'H'},
+		{"import",      required_argument, 0, 'i'},
+		{"issuer",      required_argument, 0, 'I'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"keep-going",  optional_argument, 0, 'k'},
+		{"keytab",      required_argument, 0, 'K'},
+		{"lenient",     no_argument,       0, 'l'},
+		{"match",       required_argument, 0, 'm'},
+		{"name",        required_argument, 0, 'N'},
+		{"passphrase",  required_argument, 0, 'S'},
+		{"period",      required_argument, 0, 'p'},
+		{"pipeline",    no_argument,       0, 'P'},
+		{"qr",          required_argument, 0, 'q'},
+		{"qr-dir",      required_argument, 0, 'O'},
+		{"qr-level",    required_argument, 0, 'Q'},
+		{"remaining",   no_argument,       0, 'r'},
+		{"serve-stdio", no_argument,       0, 's'},
+		{"steps",       required_argument, 0, 'n'},
+		{"table",       required_argument, 0, 'T'},
+		{"tagged",      no_argument,       0, 't'},
+		{"uri",         no_argument,       0, 'u'},
+		{"watch",       no_argument,       0, 'w'},
 		{0},
 	};
 
 #if __OpenBSD__
-	if (unveil(NULL, NULL) == -1)
-		err(EXIT_FAILURE, "unveil");
-	/* exec for -h */
-	if (pledge("exec stdio", NULL) == -1)
+	/* exec for -h; the file-system promises are dropped again once we
+	   know which files the options name */
+	if (pledge("exec stdio rpath wpath cpath unveil", NULL) == -1)
 		err(EXIT_FAILURE, "pledge");
 #endif
 
 	argv[0] = basename(argv[0]);
-	while ((opt = getopt_long(argc, argv, "d:hp:", longopts, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "b::C:c:D::d:e:f:g:HhI:i:j:K:k::lm:N:n:O:o:Pp:Q:q:rS:stT:uwx", longopts, NULL)) != -1) {
 		switch (opt) {
 		case 'h':
 			execlp("man", "man", "1", argv[0], NULL);
+			err(1, "execlp: man");
+		case 'b':
+			cfg.format = FMTBIN;
+			cfg.binflags = 0;
+			for (char *p = optarg; p != NULL && *p != 0;) {
+				size_t n = strcspn(p, ",");
+				if (n == 5 && strncmp(p, "trunc", 5) == 0)
+					cfg.binflags |= BINTRUNC;
+				else if (n == 7 && strncmp(p, "counter", 7) == 0)
+					cfg.binflags |= BINCTR;
+				else if (n == 2 && strncmp(p, "id", 2) == 0)
+					cfg.binflags |= BINID;
+				else
+					errx(1, "%.*s: invalid binary field", (int)n, p);
+				p += n + (p[n] == ',');
+			}
+			break;
+		case 'c':
+			cflag = optarg;
+			break;
+		case 'e':
+			eflag = optarg;
+			break;
+		case 'k':
+			if (optarg == NULL)
+				cfg.onerr = ERRMARK;
+			else if (strcmp(optarg, "skip") == 0)
+				cfg.onerr = ERRSKIP;
+			else
+				errx(1, "%s: invalid error mode", optarg);
+			break;
+		case 'f':
+			fflag = optarg;
+			break;
+		case 'i':
+			if (strcmp(optarg, "google") == 0)
+				iflag = IMPGOOGLE;
+			else if (strcmp(optarg, "aegis") == 0)
+				iflag = IMPAEGIS;
+			else if (strcmp(optarg, "andotp") == 0)
+				iflag = IMPANDOTP;
+			else
+				errx(1, "%s: invalid import format", optarg);
+			break;
+		case 'o':
+			if (strcmp(optarg, "text") == 0)
+				cfg.format = FMTTEXT;
+			else if (strcmp(optarg, "json") == 0)
+				cfg.format = FMTJSON;
+			else if (strcmp(optarg, "csv") == 0)
+				cfg.format = FMTCSV;
+			else if (strcmp(optarg, "binary") == 0)
+				cfg.format = FMTBIN;
+			else
+				errx(1, "%s: invalid output format", optarg);
+			break;
+		case 'q':
+			if (strcmp(optarg, "text") == 0)
+				qflag = QRTEXT;
+			else if (strcmp(optarg, "svg") == 0)
+				qflag = QRSVG;
+			else if (strcmp(optarg, "pbm") == 0)
+				qflag = QRPBM;
+			else if (strcmp(optarg, "png") == 0)
+				qflag = QRPNG;
+			else
+				errx(1, "%s: invalid QR code format", optarg);
+			break;
+		case 'Q':
+			if (strcmp(optarg, "L") == 0)
+				Qflag = QRECCL;
+			else if (strcmp(optarg, "M") == 0)
+				Qflag = QRECCM;
+			else if (strcmp(optarg, "Q") == 0)
+				Qflag = QRECCQ;
+			else if (strcmp(optarg, "H") == 0)
+				Qflag = QRECCH;
+			else
+				errx(1, "%s: invalid error correction level", optarg);
+			break;
+		case 'H':
+			Hflag = true;
+			break;
+		case 'l':
+			lflag = true;
+			break;
+		case 'P':
+			Pflag = true;
+			break;
+		case 'r':
+			rflag = true;
+			break;
+		case 's':
+			sflag = true;
+			break;
+		case 't':
+			tflag = true;
+			break;
+		case 'C':
+			Cflag = optarg;
+			break;
+		case 'I':
+			Iflag = optarg;
+			break;
+		case 'K':
+			Kflag = optarg;
+			break;
+		case 'N':
+			Nflag = optarg;
+			break;
+		case 'O':
+			Oflag = optarg;
+			break;
+		case 'S':
+			Sflag = optarg;
+			break;
+		case 'T':
+			Tflag = optarg;
+			break;
+		case 'u':
+			uflag = true;
+			break;
+		case 'w':
+			wflag = true;
+			break;
+		case 'x':
+			xflag = true;
+			break;
+		case 'D':
+			if (optarg == NULL) {
+				cfg.dedup = DDDEFAULT;
+				break;
+			}
+			/* fallthrough */
 		case 'd':
+		case 'g':
+		case 'j':
+		case 'n':
 		case 'p': {
 			/* strtol() allows for numbers with leading spaces and a
 			   ‘+’/‘-’.  We don’t want that, so assert that the input
@@ -86,97 +319,559 @@ main(int argc, char **argv)
 
 			if (n == 0)
 				errx(1, "%s: integer must be non-zero", optarg);
-			if (opt == 'd')
+			/* pow32() overflows past 10⁹ */
+			if (opt == 'd' && n > 9)
+				errx(1, "%s: too many digits", optarg);
+			if (opt == 'D')
+				cfg.dedup = (size_t)n;
+			else if (opt == 'd')
 				digits = (int)n;
+			else if (opt == 'g')
+				ngen = (int)n;
+			else if (opt == 'j')
+				jobs = (int)n;
+			else if (opt == 'n')
+				steps = (int)n;
 			else
 				period = (int)n;
 			break;
 		}
+		case 'm':
+			for (const char *p = optarg; *p != 0; p++) {
+				if (!xisdigit(*p))
+					errx(1, "%s: invalid code", optarg);
+			}
+			if (optarg[0] == 0 || strlen(optarg) > 9)
+				errx(1, "%s: invalid code", optarg);
+			mflag = optarg;
+			break;
 		default:
 			usage(argv[0]);
 		}
 	}
 
 #if __OpenBSD__
-	if (pledge("stdio", NULL) == -1)
+	if (cflag != NULL && unveil(cflag, "r") == -1)
+		err(EXIT_FAILURE, "unveil: %s", cflag);
+	if (Cflag != NULL && unveil(Cflag, "rwc") == -1)
+		err(EXIT_FAILURE, "unveil: %s", Cflag);
+	if (eflag != NULL && unveil(eflag, "wc") == -1)
+		err(EXIT_FAILURE, "unveil: %s", eflag);
+	if (fflag != NULL && unveil(fflag, "r") == -1)
+		err(EXIT_FAILURE, "unveil: %s", fflag);
+	if (Kflag != NULL && unveil(Kflag, "r") == -1)
+		err(EXIT_FAILURE, "unveil: %s", Kflag);
+	if (Oflag != NULL && unveil(Oflag, "rwc") == -1)
+		err(EXIT_FAILURE, "unveil: %s", Oflag);
+	if (Sflag != NULL && unveil(Sflag, "r") == -1)
+		err(EXIT_FAILURE, "unveil: %s", Sflag);
+	if (Tflag != NULL && unveil(Tflag, "rwc") == -1)
+		err(EXIT_FAILURE, "unveil: %s", Tflag);
+	if (unveil(NULL, NULL) == -1)
+		err(EXIT_FAILURE, "unveil");
+	if (pledge(cflag != NULL || Cflag != NULL || eflag != NULL || fflag != NULL
+	           || Kflag != NULL || Oflag != NULL || Tflag != NULL
+	           ? "stdio rpath wpath cpath" : "stdio", NULL) == -1)
+	{
 		err(EXIT_FAILURE, "pledge");
+	}
 #endif
 
+	if (cflag != NULL && argc - optind != 2)
+		usage(argv[0]);
+	if (sflag && argc - optind != 0)
+		usage(argv[0]);
+	if (ngen != 0 && argc - optind != 0)
+		usage(argv[0]);
+	if (xflag && iflag == IMPNONE)
+		usage(argv[0]);
+	if (Sflag != NULL && Cflag == NULL && Kflag == NULL)
+		usage(argv[0]);
+	if (ngen == 0 && (qflag != QRNONE || Oflag != NULL))
+		usage(argv[0]);
+	if (Oflag != NULL && qflag == QRNONE)
+		usage(argv[0]);
+
 	argc -= optind;
 	argv += optind;
 
-	if (argc == 0)
-		process_stdin();
-	else for (int i = 0; i < argc; i++)
-		process(argv[i], strlen(argv[i]));
+	if (cflag != NULL)
+		return check(cflag, argv);
+	if (sflag) {
+		serve_stdio(digits, period, lflag);
+		return EXIT_SUCCESS;
+	}
+	if (ngen != 0) {
+		generate((size_t)ngen, &(gencfg_t){
+			.name = Nflag != NULL ? Nflag : "%n",
+			.issuer = Iflag,
+			.digits = digits,
+			.period = period,
+			.qrdir = Oflag,
+			.qr = qflag,
+			.qrecc = Qflag,
+			.tagged = tflag,
+			.uri = uflag,
+		});
+		return EXIT_SUCCESS;
+	}
 
-	return EXIT_SUCCESS;
+	errf = stderr;
+	if (eflag != NULL && (errf = fopen(eflag, "w")) == NULL)
+		err(1, "fopen: %s", eflag);
+
+	cfg.digits = digits;
+	cfg.period = period;
+	cfg.remaining = rflag;
+	cfg.tagged = tflag;
+	cfg.uri = uflag;
+	cfg.lax = lflag;
+	if (Sflag != NULL)
+		loadpass(Sflag);
+	if (Kflag != NULL)
+		return keycodes(Kflag, argv, argc);
+	if (cfg.dedup != 0)
+		dedup_init(dd = &_dd, cfg.dedup, cfg.lax);
+	acctab_init(&accts, Hflag);
+
+	void (*fn)(const char *, size_t) = Cflag != NULL || mflag != NULL
+	                                 || Tflag != NULL || wflag
+	                                 ? addacct : process;
+
+	if (fn == process && !xflag && cfg.format == FMTBIN) {
+		char hdr[sizeof(binhdr_t)];
+		fwrite(hdr, 1, fmthdr(hdr, &cfg), stdout);
+	}
+
+	if (iflag != IMPNONE)
+		fn = importline;
+
+	if (iflag > IMPGOOGLE && (fflag != NULL || argc == 0))
+		importdoc();
+	else if (Pflag && fn == process && (fflag != NULL || argc == 0))
+		lineno = pipeline_run(fflag, jobs != 0 ? jobs : 1, &cfg, lineerr);
+	else if (jobs != 0 && fn == process && (fflag != NULL || argc == 0))
+		batch();
+	else if (fflag != NULL)
+		input_file(fflag, fn);
+	else if (argc == 0)
+		input_fd(STDIN_FILENO, fn);
+	for (int i = 0; i < argc; i++)
+		fn(argv[i], strlen(argv[i]));
+
+	if (nerrs != 0 && fflush(errf) == EOF)
+		err(1, "fflush");
+	if (Cflag != NULL) {
+		keytab_write(Cflag, &accts, tflag, jobs,
+		             Sflag != NULL ? (uint8_t *)pass.p : NULL, passsz);
+		droppass();
+	}
+	if (mflag != NULL)
+		return match(mflag);
+	if (Tflag != NULL)
+		mktable(Tflag);
+	if (wflag) {
+		if (accts.n == 0)
+			errx(1, "no secrets to watch");
+		watch(&accts, tflag, rflag);
+	}
+	return nerrs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 void
-process_stdin(void)
+process(const char *s, size_t n)
 {
-	ssize_t nr;
-	size_t len;
-	char *line = NULL;
-	while ((nr = getline(&line, &len, stdin)) != -1) {
-		if (line[nr - 1] == '\n')
-			line[--nr] = 0;
-		process(line, nr);
+	static char *buf;
+	static size_t bufsz;
+
+	if (bufsz < FMTSZ(n)) {
+		bufsz = FMTSZ(n);
+		if ((buf = realloc(buf, bufsz)) == NULL)
+			err(1, "realloc");
+	}
+
+	/* time(2) claims that this call will never fail if passed a NULL
+	   argument.  We cast the time_t to uint64_t which will always be
+	   safe to do. */
+	cfg.now = (uint64_t)time(NULL);
+
+	int e;
+	char *end = fmtline(buf, s, n, &cfg, dd, &e);
+	lineno++;
+	if (end == NULL) {
+		lineerr(lineno, e, s, n);
+		end = fmtbad(buf, s, n, &cfg);
 	}
-	if (errno != 0)
-		err(1, "getline");
+	fwrite(buf, 1, (size_t)(end - buf), stdout);
 }
 
+/* Process the whole input file or standard input with -j worker
+   threads */
 void
-process(const char *s, size_t n)
+batch(void)
+{
+	int fd = STDIN_FILENO;
+	if (fflag != NULL && (fd = open(fflag, O_RDONLY)) == -1)
+		err(1, "open: %s", fflag);
+
+	input_buf_t b;
+	input_load(&b, fd);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	cfg.now = (uint64_t)time(NULL);
+	lineno = parallel_run(b.p, b.n, jobs, &cfg, lineerr);
+	input_release(&b);
+}
+
+void
+addacct(const char *s, size_t n)
+{
+	fields_t f;
+	int e = parsefields(&f, s, n, &cfg);
+	if (e == KEYOK && f.hotp)
+		e = RECHOTP;
+	if (e != KEYOK)
+		keyerr(e, s, n);
+
+	hmac_sha1_key_t key;
+	decode(&key, f.sec, f.secn);
+	acctab_add(&accts, &key, f.digits, f.period, f.id, f.idn);
+}
+
+/* Read the accounts of the export S of length N in the format given by
+   -i, treating them as if they were tagged input lines.  Errors in one
+   account are reported with the line number of the whole export. */
+void
+importline(const char *s, size_t n)
+{
+	lineno++;
+	int e = importers[iflag](s, n, imported, NULL);
+	if (e != KEYOK)
+		lineerr(lineno, e, s, n);
+}
+
+/* Import the whole input file or standard input as a single document */
+void
+importdoc(void)
+{
+	int fd = STDIN_FILENO;
+	if (fflag != NULL && (fd = open(fflag, O_RDONLY)) == -1)
+		err(1, "open: %s", fflag);
+
+	input_buf_t b;
+	input_load(&b, fd);
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	/* Don’t report the whole document on error */
+	const char *name = fflag != NULL ? fflag : "<stdin>";
+	lineno++;
+	int e = importers[iflag](b.p, b.n, imported, NULL);
+	if (e != KEYOK)
+		lineerr(lineno, e, name, strlen(name));
+	input_release(&b);
+}
+
+void
+imported(const imacct_t *a, void *arg)
 {
-	/* Remove padding bytes */
-	while (n > 0 && s[n - 1] == '=')
-		n--;
-	if (n == 0)
-		errx(1, "empty base32 input");
+	(void)arg;
 
-	static uint8_t _key[256];
-	uint8_t *key = _key;
+	/* Room for the longest ID and an exported secret */
+	char id[IMPSTRMAX * 2 + 1], buf[FMTSZ(sizeof(id))];
+	size_t idn = imid(id, a);
 
-	size_t keysz = n * 5 / 8;
-	if (keysz > sizeof(_key)) {
-		if ((key = malloc(keysz)) == NULL)
-			err(1, "malloc");
+	int e = a->err;
+	hmac_sha1_key_t key;
+	if (e == KEYOK && a->key != NULL)
+		hmac_sha1key(&key, a->key, a->keysz);
+	else if (e == KEYOK)
+		e = b32key(&key, a->sec, a->secn, cfg.lax);
+	if (e == KEYOK && a->hotp && (xflag || Cflag != NULL || mflag != NULL
+	                              || Tflag != NULL || wflag))
+	{
+		e = RECHOTP;
 	}
 
-	if (!b32toa(key, s, n))
-		errx(1, "%s: invalid base32 input", s);
+	if (e != KEYOK) {
+		lineerr(lineno, e, id, idn);
+		if (!xflag && Cflag == NULL && mflag == NULL && Tflag == NULL
+		    && !wflag)
+		{
+			char *end = fmtbad(buf, id, idn, &cfg);
+			fwrite(buf, 1, (size_t)(end - buf), stdout);
+		}
+		return;
+	}
 
-	/* time(2) claims that this call will never fail if passed a NULL
-	   argument.  We cast the time_t to uint64_t which will always be
-	   safe to do. */
-	uint64_t epoch = htobe64((uint64_t)time(NULL) / (uint64_t)period);
-	uint8_t dgst[SHA1DGSTSZ];
-	hmac_sha1(dgst, key, keysz, (uint8_t *)&epoch, sizeof(epoch));
-
-	int off = dgst[19] & 0x0F;
-	uint32_t binc = (dgst[off + 0] & 0x7F) << 24
-	              | (dgst[off + 1] & 0xFF) << 16
-	              | (dgst[off + 2] & 0xFF) <<  8
-	              | (dgst[off + 3] & 0xFF) <<  0;
-	printf("%0*" PRId32 "\n", digits, binc % pow32(10, digits));
-
-	if (key != _key)
-		free(key);
-}
-
-/* TODO: Check for overflow? */
-uint32_t
-pow32(uint32_t x, uint32_t y)
-{
-	uint32_t n = x;
-	if (y == 0)
-		return 1;
-	while (--y != 0)
-		x *= n;
-	return x;
+	int digits = a->digits != 0 ? a->digits : cfg.digits;
+	int period = a->period != 0 ? a->period : cfg.period;
+
+	if (Cflag != NULL || mflag != NULL || Tflag != NULL || wflag) {
+		acctab_add(&accts, &key, digits, period, id, idn);
+		return;
+	}
+
+	/* Write the account out as a tagged input line */
+	if (xflag) {
+		char *p = buf;
+		memcpy(p, id, idn);
+		p += idn;
+		*p++ = '\t';
+		if (a->key != NULL)
+			p += atob32(p, a->key, a->keysz);
+		else {
+			memcpy(p, a->sec, a->secn);
+			p += a->secn;
+		}
+		p += sprintf(p, "\t%d\t%d\n", digits, period);
+		fwrite(buf, 1, (size_t)(p - buf), stdout);
+		return;
+	}
+
+	record_t r = {
+		.f.id      = tflag ? id : NULL,
+		.f.idn     = tflag ? idn : 0,
+		.f.digits  = digits,
+		.f.period  = period,
+		.f.hotp    = a->hotp,
+		.f.counter = a->counter,
+	};
+	cfg.now = (uint64_t)time(NULL);
+	mkcode(&r, &key, &cfg);
+	char *end = fmtrecord(buf, &r, &cfg);
+	fwrite(buf, 1, (size_t)(end - buf), stdout);
+}
+
+/* Write the ID of A, ‘issuer:name’ or just the name if there is no
+   issuer, to DST.  Tabs and newlines would break tagged lines and so are
+   replaced with spaces. */
+size_t
+imid(char *dst, const imacct_t *a)
+{
+	size_t n = 0;
+	if (a->issuern != 0) {
+		memcpy(dst, a->issuer, a->issuern);
+		n = a->issuern;
+		dst[n++] = ':';
+	}
+	if (a->namen != 0) {
+		memcpy(dst + n, a->name, a->namen);
+		n += a->namen;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (dst[i] == '\t' || dst[i] == '\n' || dst[i] == '\r')
+			dst[i] = ' ';
+	}
+	return n;
+}
+
+/* Print the IDs, or 1-based positions if the input isn’t tagged, of all
+   secrets whose current code is CODE.  Like grep(1) we exit
+   unsuccessfully if nothing matched. */
+int
+match(const char *code)
+{
+	codeidx_t ci;
+	codeidx_init(&ci, &accts);
+	codeidx_refresh(&ci, time(NULL));
+
+	size_t n;
+	const uint32_t *hits = codeidx_lookup(&ci, (uint32_t)strtoul(code, NULL, 10),
+	                                      (int)strlen(code), &n);
+	for (size_t i = 0; i < n; i++) {
+		if (tflag)
+			puts(acctab_label(&accts, hits[i]));
+		else
+			printf("%" PRIu32 "\n", hits[i] + 1);
+	}
+
+	codeidx_free(&ci);
+	acctab_free(&accts);
+	return n != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Write a code table covering the next STEPS periods (one week by
+   default) for every account.  Accounts are identified by their ID, or
+   by their 1-based position in the input if it isn’t tagged. */
+void
+mktable(const char *path)
+{
+	uint64_t *ids = malloc((accts.n ? accts.n : 1) * sizeof(*ids));
+	if (ids == NULL)
+		err(1, "malloc");
+	for (size_t i = 0; i < accts.n; i++) {
+		const char *l = acctab_label(&accts, i);
+		if (tflag) {
+			ids[i] = codetab_id(l, strlen(l));
+		} else {
+			char buf[32];
+			int n = snprintf(buf, sizeof(buf), "%zu", i + 1);
+			ids[i] = codetab_id(buf, (size_t)n);
+		}
+	}
+
+	codetab_write(path, &accts, ids, (uint64_t)time(NULL), (uint32_t)steps,
+	              jobs);
+
+	free(ids);
+	acctab_free(&accts);
+}
+
+/* Verify CODE for ACCOUNT against the code table at PATH.  ACCOUNT is
+   1-based, or with -t the account’s ID.  Exits unsuccessfully if the
+   code is wrong or the table doesn’t cover the current time. */
+int
+check(const char *path, char **argv)
+{
+	char *endptr;
+	unsigned long acct = 0;
+	if (!tflag) {
+		acct = strtoul(argv[0], &endptr, 10);
+		if (!xisdigit(argv[0][0]) || *endptr != 0 || acct == 0)
+			errx(1, "%s: invalid account", argv[0]);
+	}
+	unsigned long code = strtoul(argv[1], &endptr, 10);
+	if (!xisdigit(argv[1][0]) || *endptr != 0)
+		errx(1, "%s: invalid code", argv[1]);
+
+	codetab_t t;
+	codetab_open(&t, path);
+
+	size_t i = acct - 1;
+	if (tflag && !codetab_find(&t, argv[0], strlen(argv[0]), &i))
+		errx(1, "%s: no such account", argv[0]);
+
+	uint32_t want;
+	uint64_t step = (uint64_t)time(NULL) / t.period;
+	if (!codetab_code(&t, i, step, &want))
+		errx(1, "%s: no code for account %s at the current time", path,
+		     argv[0]);
+
+	bool ok = strlen(argv[1]) == (size_t)t.digits && code == want;
+	codetab_close(&t);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Print the current codes of the 1-based records ARGV of the key table
+   at PATH, or of every record if ARGC is 0.  With -t the accounts are
+   given by label instead and found through the table’s index. */
+int
+keycodes(const char *path, char **argv, int argc)
+{
+	keytab_t t;
+	keytab_open(&t, path);
+	if (t.sealed && Sflag == NULL)
+		errx(1, "%s: key table is sealed; give its passphrase with -S", path);
+	if (t.sealed && !keytab_unseal(&t, (uint8_t *)pass.p, passsz))
+		errx(1, "%s: wrong passphrase or damaged key table", path);
+	droppass();
+
+	size_t idmax = 0;
+	for (int i = 0; tflag && i < argc; i++) {
+		size_t len = strlen(argv[i]);
+		idmax = len > idmax ? len : idmax;
+	}
+	char *buf = malloc(FMTSZ(idmax));
+	if (buf == NULL)
+		err(1, "malloc");
+	if (cfg.format == FMTBIN)
+		fwrite(buf, 1, fmthdr(buf, &cfg), stdout);
+
+	cfg.now = (uint64_t)time(NULL);
+	size_t n = argc != 0 ? (size_t)argc : t.nrecs;
+	for (size_t i = 0; i < n; i++) {
+		size_t rec = i;
+		if (argc != 0 && tflag) {
+			if (!keytab_find(&t, argv[i], strlen(argv[i]), &rec))
+				errx(1, "%s: no such account", argv[i]);
+		} else if (argc != 0) {
+			char *endptr;
+			unsigned long x = strtoul(argv[i], &endptr, 10);
+			if (!xisdigit(argv[i][0]) || *endptr != 0 || x == 0)
+				errx(1, "%s: invalid record", argv[i]);
+			rec = x - 1;
+		}
+
+		account_t a;
+		if (!keytab_acct(&t, rec, &a))
+			errx(1, "%s: no usable record %zu", path, rec + 1);
+		record_t r = {.f = {.digits = a.digits, .period = a.period}};
+		if (argc != 0 && tflag) {
+			r.f.id = argv[i];
+			r.f.idn = strlen(argv[i]);
+		}
+		mkcode(&r, &a.key, &cfg);
+		fwrite(buf, 1, (size_t)(fmtrecord(buf, &r, &cfg) - buf), stdout);
+	}
+
+	free(buf);
+	keytab_close(&t);
+	return EXIT_SUCCESS;
+}
+
+/* Load the passphrase for -S from the file at PATH, less a trailing
+   newline */
+void
+loadpass(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		err(1, "open: %s", path);
+	input_load(&pass, fd);
+	close(fd);
+
+	passsz = pass.n;
+	if (passsz > 0 && pass.p[passsz - 1] == '\n')
+		passsz--;
+	if (passsz == 0)
+		errx(1, "%s: empty passphrase", path);
+}
+
+void
+droppass(void)
+{
+	if (pass.p == NULL)
+		return;
+	if (!pass.mapped)
+		memset(pass.p, 0, pass.n);
+	input_release(&pass);
+	pass.p = NULL;
+}
+
+void
+decode(hmac_sha1_key_t *k, const char *s, size_t n)
+{
+	int e = b32key(k, s, n, cfg.lax);
+	if (e != KEYOK)
+		keyerr(e, s, n);
+}
+
+/* Report that line LINE (S of length N) is invalid for reason E.  Unless
+   we were told to keep going this is fatal; otherwise a record is
+   written to the error file, and the secret itself is left out of it. */
+void
+lineerr(size_t line, int e, const char *s, size_t n)
+{
+	if (cfg.onerr == ERRABORT)
+		keyerr(e, s, n);
+
+	if (cfg.format == FMTJSON) {
+		fprintf(errf, "{\"line\":%zu,\"error\":\"%s\"}\n", line,
+		        fmtstrerror(e));
+	} else
+		fprintf(errf, "%zu\t%s\n", line, fmtstrerror(e));
+	nerrs++;
+}
+
+void
+keyerr(int e, const char *s, size_t n)
+{
+	if (e == KEYEMPTY)
+		errx(1, "%s", fmtstrerror(e));
+	errx(1, "%.*s: %s", (int)n, s, fmtstrerror(e));
 }
 
 bool
@@ -0,0 +1,297 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "fmt.h"
+#include "import.h"
+#include "uri.h"
+
+#define MIGPREFIX "otpauth-migration://offline?"
+
+/* Protobuf wire types */
+enum {
+	WTVARINT = 0,
+	WTI64    = 1,
+	WTLEN    = 2,
+	WTI32    = 5,
+};
+
+/* A reader of the bytes of a percent-encoded base64 string.  OFF counts
+   the bytes read so far so that nested messages can find their end. */
+struct rd {
+	const char *p, *end;
+	uint32_t acc;
+	int nbits;
+	size_t off;
+	bool bad;
+};
+
+static int rdbyte(struct rd *);
+static bool rdvarint(struct rd *, uint64_t *);
+static bool rdskip(struct rd *, int);
+static size_t rdbytes(struct rd *, void *, size_t, size_t);
+static int account(struct rd *, size_t, imacct_t *, uint8_t *, char *,
+                   char *);
+static inline int b64val(char)
+	__attribute__((always_inline, const));
+
+/* Decode the Google Authenticator export S of length N, an
+   otpauth-migration:// URI holding a base64-encoded protobuf
+   MigrationPayload, calling FN on each account in turn.  The payload is
+   base64-decoded and parsed in a single pass, and each account is built
+   in buffers on the stack, so nothing is allocated.  Returns KEYOK or
+   RECMIG if the payload is malformed, in which case the accounts before
+   the error will already have been passed to FN. */
+int
+import_google(const char *s, size_t n, imfn_t *fn, void *arg)
+{
+	const char *end = s + n, *p;
+
+	if (n < sizeof(MIGPREFIX) - 1
+	 || memcmp(s, MIGPREFIX, sizeof(MIGPREFIX) - 1) != 0)
+	{
+		return RECMIG;
+	}
+
+	/* Find the data parameter */
+	for (p = s + sizeof(MIGPREFIX) - 1;; p++) {
+		if (end - p >= 5 && memcmp(p, "data=", 5) == 0)
+			break;
+		if ((p = memchr(p, '&', (size_t)(end - p))) == NULL)
+			return RECMIG;
+	}
+	p += 5;
+
+	struct rd r = {.p = p};
+	if ((r.end = memchr(p, '&', (size_t)(end - p))) == NULL)
+		r.end = end;
+
+	for (;;) {
+		uint64_t tag, len;
+		if (!rdvarint(&r, &tag))
+			break;
+
+		/* Field 1 is the repeated OtpParameters; version and batch
+		   information is of no interest */
+		if (tag != (1 << 3 | WTLEN)) {
+			if (!rdskip(&r, (int)(tag & 7)))
+				return RECMIG;
+			continue;
+		}
+
+		if (!rdvarint(&r, &len))
+			return RECMIG;
+
+		uint8_t key[IMPKEYMAX];
+		char name[IMPSTRMAX], issuer[IMPSTRMAX];
+		imacct_t a = {0};
+		if (account(&r, r.off + len, &a, key, name, issuer) != KEYOK)
+			return RECMIG;
+		fn(&a, arg);
+	}
+
+	return r.bad ? RECMIG : KEYOK;
+}
+
+/* Read an OtpParameters message ending at offset END into A, storing
+   its strings in KEY, NAME, and ISSUER which must have room for
+   IMPKEYMAX and IMPSTRMAX bytes.  Unknown fields are skipped. */
+int
+account(struct rd *r, size_t end, imacct_t *a, uint8_t *key, char *name,
+        char *issuer)
+{
+	a->key = key;
+	a->name = name;
+	a->issuer = issuer;
+
+	uint64_t algo = 0, digits = 0, type = 0;
+
+	while (r->off < end) {
+		uint64_t tag, v;
+		if (!rdvarint(r, &tag))
+			return RECMIG;
+
+		int wt = (int)(tag & 7);
+		switch (tag >> 3) {
+		case 1:
+		case 2:
+		case 3:
+			if (wt != WTLEN || !rdvarint(r, &v) || v > end - r->off)
+				return RECMIG;
+			break;
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+			if (wt != WTVARINT || !rdvarint(r, &v))
+				return RECMIG;
+			break;
+		default:
+			if (!rdskip(r, wt))
+				return RECMIG;
+			continue;
+		}
+
+		switch (tag >> 3) {
+		case 1:
+			a->keysz = rdbytes(r, key, IMPKEYMAX, (size_t)v);
+			/* Too long to keep */
+			if (a->keysz != v)
+				a->err = KEYINVAL;
+			break;
+		case 2:
+			a->namen = rdbytes(r, name, IMPSTRMAX, (size_t)v);
+			break;
+		case 3:
+			a->issuern = rdbytes(r, issuer, IMPSTRMAX, (size_t)v);
+			break;
+		case 4:
+			algo = v;
+			break;
+		case 5:
+			digits = v;
+			break;
+		case 6:
+			type = v;
+			break;
+		case 7:
+			a->counter = v;
+			break;
+		}
+		if (r->bad)
+			return RECMIG;
+	}
+	if (r->off != end)
+		return RECMIG;
+
+	/* The enums are ALGORITHM_SHA1 = 1, DIGIT_COUNT_SIX = 1,
+	   DIGIT_COUNT_EIGHT = 2, and OTP_TYPE_HOTP = 1, with 0 meaning
+	   unspecified */
+	a->hotp = type == 1;
+	a->digits = digits == 2 ? 8 : 6;
+	if (a->err == KEYOK) {
+		a->err = a->keysz == 0 ? KEYEMPTY
+		       : algo > 1      ? RECALGO
+		       : digits > 2    ? RECDIGITS
+		       : KEYOK;
+	}
+	return KEYOK;
+}
+
+/* Read N bytes into the buffer DST of size CAP, discarding any that don’t
+   fit, and return the number stored */
+size_t
+rdbytes(struct rd *r, void *dst, size_t cap, size_t n)
+{
+	uint8_t *d = dst;
+	size_t i;
+	for (i = 0; i < n; i++) {
+		int c = rdbyte(r);
+		if (c == -1) {
+			r->bad = true;
+			break;
+		}
+		if (i < cap)
+			d[i] = (uint8_t)c;
+	}
+	return i < cap ? i : cap;
+}
+
+bool
+rdvarint(struct rd *r, uint64_t *v)
+{
+	*v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		int c = rdbyte(r);
+		if (c == -1) {
+			/* Running out before a varint starts is a clean end */
+			r->bad |= shift != 0;
+			return false;
+		}
+		*v |= (uint64_t)(c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			return true;
+	}
+	r->bad = true;
+	return false;
+}
+
+bool
+rdskip(struct rd *r, int wt)
+{
+	uint64_t v;
+	switch (wt) {
+	case WTVARINT:
+		return rdvarint(r, &v);
+	case WTI64:
+		v = 8;
+		break;
+	case WTLEN:
+		if (!rdvarint(r, &v))
+			return false;
+		break;
+	case WTI32:
+		v = 4;
+		break;
+	default:
+		return false;
+	}
+	while (v-- > 0) {
+		if (rdbyte(r) == -1)
+			return false;
+	}
+	return true;
+}
+
+/* Return the next decoded byte, or -1 at the end of the data or on an
+   invalid character, in which case BAD is set */
+int
+rdbyte(struct rd *r)
+{
+	while (r->nbits < 8) {
+		if (r->p == r->end)
+			return -1;
+
+		char c = *r->p++;
+		if (c == '%') {
+			int hi, lo;
+			if (r->end - r->p < 2 || (hi = uri_unhex(r->p[0])) == -1
+			    || (lo = uri_unhex(r->p[1])) == -1)
+			{
+				r->bad = true;
+				return -1;
+			}
+			c = (char)(hi << 4 | lo);
+			r->p += 2;
+		}
+		if (c == '=') {
+			r->p = r->end;
+			return -1;
+		}
+
+		int v = b64val(c);
+		if (v == -1) {
+			r->bad = true;
+			return -1;
+		}
+		r->acc = r->acc << 6 | (uint32_t)v;
+		r->nbits += 6;
+	}
+
+	r->nbits -= 8;
+	r->off++;
+	return (int)(r->acc >> r->nbits & 0xFF);
+}
+
+/* Both the standard and the URL-safe alphabets are accepted */
+int
+b64val(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A'
+	     : c >= 'a' && c <= 'z' ? c - 'a' + 26
+	     : c >= '0' && c <= '9' ? c - '0' + 52
+	     : c == '+' || c == '-' ? 62
+	     : c == '/' || c == '_' ? 63
+	     : -1;
+}
@@ -0,0 +1,275 @@
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "dedup.h"
+#include "fmt.h"
+#include "parallel.h"
+#include "totp.h"
+
+/* Bounds on the number of input bytes per chunk */
+#define CHUNKMIN (16 << 10)
+#define CHUNKMAX (1 << 20)
+
+struct bad {
+	const char *s;
+	size_t n, line;
+	int err;
+};
+
+struct chunk {
+	const char *p;
+	size_t n, nlines;
+
+	char *out;
+	size_t outsz;
+
+	/* The invalid lines, numbered relative to the chunk.  Unless the
+	   configuration says to keep going, the first one ends the chunk. */
+	struct bad *bad;
+	size_t nbad, badcap;
+
+	bool done;
+};
+
+/* The chunks a worker has yet to process, stored as a half-open range
+   [lo, hi) packed into a single word.  The owner takes chunks from the
+   front and thieves take them from the back, so the owner works through
+   the input in order while idle workers relieve it of the chunks it
+   would have reached last.  Ranges only ever shrink, so a worker that
+   finds every range empty can exit. */
+struct deque {
+	_Alignas(64) atomic_uint_least64_t range;
+};
+
+struct pool {
+	struct chunk *chunks;
+	size_t nchunks;
+	struct deque *dqs;
+	int nthreads;
+	const fmtcfg_t *cfg;
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+};
+
+struct worker {
+	struct pool *pool;
+	int id;
+	pthread_t thrd;
+	dedup_t dd;
+};
+
+static void *work(void *);
+static void run(struct chunk *, const fmtcfg_t *, dedup_t *);
+static bool take(struct deque *, bool, uint32_t *);
+static size_t split(struct chunk **, const char *, size_t, int);
+
+/* Compute the codes for every line in BUF using NTHREADS worker threads
+   and write them to the standard output in input order.  Every worker
+   formats its chunks into private buffers which are written out by the
+   calling thread as soon as all preceding chunks have been.  ONERR is
+   called with the 1-based line number of every invalid line once all
+   output before it has been written.  Returns the number of lines. */
+size_t
+parallel_run(const char *buf, size_t n, int nthreads, const fmtcfg_t *cfg,
+             void (*onerr)(size_t, int, const char *, size_t))
+{
+	struct pool p = {
+		.nthreads = nthreads,
+		.cfg      = cfg,
+		.mtx      = PTHREAD_MUTEX_INITIALIZER,
+		.cv       = PTHREAD_COND_INITIALIZER,
+	};
+
+	p.nchunks = split(&p.chunks, buf, n, nthreads);
+
+	struct worker *ws = calloc((size_t)nthreads, sizeof(*ws));
+	p.dqs = aligned_alloc(_Alignof(struct deque),
+	                      (size_t)nthreads * sizeof(*p.dqs));
+	if (ws == NULL || p.dqs == NULL)
+		err(1, "malloc");
+
+	for (int i = 0; i < nthreads; i++) {
+		uint64_t lo = p.nchunks * (size_t)i / (size_t)nthreads,
+		         hi = p.nchunks * (size_t)(i + 1) / (size_t)nthreads;
+		atomic_init(&p.dqs[i].range, hi << 32 | lo);
+	}
+
+	for (int i = 0; i < nthreads; i++) {
+		ws[i].pool = &p;
+		ws[i].id = i;
+		if ((errno = pthread_create(&ws[i].thrd, NULL, work, ws + i)) != 0)
+			err(1, "pthread_create");
+	}
+
+	size_t line = 1;
+	for (size_t i = 0; i < p.nchunks; i++) {
+		struct chunk *c = p.chunks + i;
+
+		pthread_mutex_lock(&p.mtx);
+		while (!c->done)
+			pthread_cond_wait(&p.cv, &p.mtx);
+		pthread_mutex_unlock(&p.mtx);
+
+		if (fwrite(c->out, 1, c->outsz, stdout) != c->outsz)
+			err(1, "fwrite");
+		free(c->out);
+
+		if (c->nbad != 0 && fflush(stdout) == EOF)
+			err(1, "fflush");
+		for (size_t j = 0; j < c->nbad; j++) {
+			struct bad *b = c->bad + j;
+			onerr(line + b->line, b->err, b->s, b->n);
+		}
+		line += c->nlines;
+		free(c->bad);
+	}
+
+	for (int i = 0; i < nthreads; i++)
+		pthread_join(ws[i].thrd, NULL);
+
+	free(ws);
+	free(p.dqs);
+	free(p.chunks);
+	return line - 1;
+}
+
+void *
+work(void *arg)
+{
+	struct worker *w = arg;
+	struct pool *p = w->pool;
+
+	dedup_t *dd = NULL;
+	if (p->cfg->dedup != 0)
+		dedup_init(dd = &w->dd, p->cfg->dedup, p->cfg->lax);
+
+	for (;;) {
+		uint32_t i;
+		bool found = take(p->dqs + w->id, true, &i);
+		for (int k = 1; !found && k < p->nthreads; k++)
+			found = take(p->dqs + (w->id + k) % p->nthreads, false, &i);
+		if (!found)
+			break;
+
+		run(p->chunks + i, p->cfg, dd);
+
+		pthread_mutex_lock(&p->mtx);
+		p->chunks[i].done = true;
+		pthread_cond_broadcast(&p->cv);
+		pthread_mutex_unlock(&p->mtx);
+	}
+
+	if (dd != NULL)
+		dedup_free(dd);
+	return NULL;
+}
+
+void
+run(struct chunk *c, const fmtcfg_t *cfg, dedup_t *dd)
+{
+	size_t cap = c->n + c->n / 2 + FMTSZ(0);
+	if ((c->out = malloc(cap)) == NULL)
+		err(1, "malloc");
+
+	const char *p = c->p, *end = c->p + c->n;
+	while (p < end) {
+		const char *nl = memchr(p, '\n', (size_t)(end - p));
+		size_t len = (size_t)((nl != NULL ? nl : end) - p);
+
+		while (cap - c->outsz < FMTSZ(len)) {
+			cap *= 2;
+			if ((c->out = realloc(c->out, cap)) == NULL)
+				err(1, "realloc");
+		}
+
+		int e;
+		char *o = fmtline(c->out + c->outsz, p, len, cfg, dd, &e);
+		if (o == NULL) {
+			if (c->nbad == c->badcap) {
+				c->badcap = c->badcap ? c->badcap * 2 : 8;
+				c->bad = realloc(c->bad, c->badcap * sizeof(*c->bad));
+				if (c->bad == NULL)
+					err(1, "realloc");
+			}
+			c->bad[c->nbad++] = (struct bad){
+				.s    = p,
+				.n    = len,
+				.line = c->nlines,
+				.err  = e,
+			};
+			if (cfg->onerr == ERRABORT)
+				return;
+			o = fmtbad(c->out + c->outsz, p, len, cfg);
+		}
+		c->outsz = (size_t)(o - c->out);
+		c->nlines++;
+
+		if (nl == NULL)
+			break;
+		p = nl + 1;
+	}
+}
+
+bool
+take(struct deque *d, bool front, uint32_t *i)
+{
+	uint64_t r = atomic_load_explicit(&d->range, memory_order_relaxed);
+	for (;;) {
+		uint64_t lo = r & UINT32_MAX, hi = r >> 32;
+		if (lo >= hi)
+			return false;
+
+		uint64_t nr = front ? hi << 32 | (lo + 1) : (hi - 1) << 32 | lo;
+		if (atomic_compare_exchange_weak(&d->range, &r, nr)) {
+			*i = (uint32_t)(front ? lo : hi - 1);
+			return true;
+		}
+	}
+}
+
+/* Split BUF into chunks ending on line boundaries.  Aim for enough
+   chunks that every thread gets several, so there is something left to
+   steal when one of them falls behind. */
+size_t
+split(struct chunk **cs, const char *buf, size_t n, int nthreads)
+{
+	size_t target = n / ((size_t)nthreads * 16);
+	if (target < CHUNKMIN)
+		target = CHUNKMIN;
+	if (target > CHUNKMAX)
+		target = CHUNKMAX;
+
+	size_t cap = n / target + 2, nc = 0;
+	if ((*cs = calloc(cap, sizeof(**cs))) == NULL)
+		err(1, "calloc");
+
+	const char *p = buf, *end = buf + n;
+	while (p < end) {
+		const char *q = p + target < end ? p + target : end;
+		const char *nl = q < end ? memchr(q, '\n', (size_t)(end - q)) : NULL;
+		q = nl != NULL ? nl + 1 : end;
+
+		if (nc == cap) {
+			cap *= 2;
+			if ((*cs = realloc(*cs, cap * sizeof(**cs))) == NULL)
+				err(1, "realloc");
+			memset(*cs + nc, 0, (cap - nc) * sizeof(**cs));
+		}
+		(*cs)[nc].p = p;
+		(*cs)[nc].n = (size_t)(q - p);
+		nc++;
+		p = q;
+	}
+
+	if (nc > UINT32_MAX)
+		errx(1, "input too large");
+	return nc;
+}
@@ -0,0 +1,11 @@
+#ifndef TOTP_PARALLEL_H
+#define TOTP_PARALLEL_H
+
+#include <stddef.h>
+
+#include "fmt.h"
+
+size_t parallel_run(const char *, size_t, int, const fmtcfg_t *,
+                  void (*)(size_t, int, const char *, size_t));
+
+#endif /* !TOTP_PARALLEL_H */
@@ -0,0 +1,346 @@
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base32.h"
+#include "common.h"
+#include "dedup.h"
+#include "fmt.h"
+#include "input.h"
+#include "pipeline.h"
+#include "totp.h"
+
+/* Secrets up to this length are stored inline in their job */
+#define SECMAX  (128)
+/* Number of jobs per ring; must be a power of two */
+#define RINGSZ  (1024)
+/* Number of consecutive lines handed to the same compute thread */
+#define BATCHSZ (64)
+
+#if __x86_64__ || __i386__
+#	define cpurelax() __builtin_ia32_pause()
+#elif __aarch64__
+#	define cpurelax() __asm__ volatile ("yield")
+#else
+#	define cpurelax() ((void)0)
+#endif
+
+/* Lines too long to store inline go in EXT, which belongs to the job's
+   slot in the ring and only ever grows, so that once it is big enough
+   for the longest line no more allocations are made */
+struct job {
+	const char *s;
+	char *ext;
+	uint32_t n, extcap;
+	int err;
+	record_t rec;
+	char sec[SECMAX];
+};
+
+/* Each compute thread owns one ring which all three stages share.  The
+   reader fills jobs at HEAD, the compute thread turns them into output
+   at MID and the writer drains them at TAIL.  Every index has exactly
+   one writer, so no locks are needed; the indices live on separate
+   cache lines so the stages don’t contend on them. */
+struct ring {
+	_Alignas(64) atomic_size_t head;
+	_Alignas(64) atomic_size_t mid;
+	_Alignas(64) atomic_size_t tail;
+	_Alignas(64) struct job jobs[RINGSZ];
+};
+
+struct spin {
+	unsigned n;
+};
+
+static void push(const char *, size_t);
+static void *compute(void *);
+static void crunch(struct ring *, size_t, size_t, const fmtcfg_t *);
+static void *writer(void *);
+static void backoff(struct spin *);
+
+static struct {
+	struct ring *rings;
+	int nthreads;
+	const fmtcfg_t *cfg;
+	void (*onerr)(size_t, int, const char *, size_t);
+
+	/* Only touched by the reader */
+	size_t nread;
+
+	/* Set once the reader is done; TOTAL is valid thereafter */
+	atomic_bool eof;
+	size_t total;
+} pl;
+
+/* Compute the codes for every line of the file at PATH (or the standard
+   input if PATH is NULL) with a three-stage pipeline: the calling thread
+   reads lines into fixed-size jobs, NTHREADS compute threads decode and
+   hash them in batches, and a writer thread formats and prints them in
+   input order, calling ONERR on any invalid line.  Returns the number of
+   lines read.  Reading, hashing and writing thus all overlap, which matters
+   for inputs that trickle in such as pipes. */
+size_t
+pipeline_run(const char *path, int nthreads, const fmtcfg_t *cfg,
+             void (*onerr)(size_t, int, const char *, size_t))
+{
+	pl.nthreads = nthreads;
+	pl.cfg = cfg;
+	pl.onerr = onerr;
+	pl.rings = aligned_alloc(_Alignof(struct ring),
+	                         (size_t)nthreads * sizeof(*pl.rings));
+	if (pl.rings == NULL)
+		err(1, "aligned_alloc");
+	for (int i = 0; i < nthreads; i++) {
+		atomic_init(&pl.rings[i].head, 0);
+		atomic_init(&pl.rings[i].mid, 0);
+		atomic_init(&pl.rings[i].tail, 0);
+		for (size_t k = 0; k < RINGSZ; k++) {
+			pl.rings[i].jobs[k].ext = NULL;
+			pl.rings[i].jobs[k].extcap = 0;
+		}
+	}
+
+	pthread_t wthrd, *cthrds = calloc((size_t)nthreads, sizeof(*cthrds));
+	if (cthrds == NULL)
+		err(1, "calloc");
+	for (int i = 0; i < nthreads; i++) {
+		if ((errno = pthread_create(cthrds + i, NULL, compute,
+		                            pl.rings + i)) != 0)
+		{
+			err(1, "pthread_create");
+		}
+	}
+	if ((errno = pthread_create(&wthrd, NULL, writer, NULL)) != 0)
+		err(1, "pthread_create");
+
+	if (path != NULL)
+		input_file(path, push);
+	else
+		input_fd(STDIN_FILENO, push);
+
+	pl.total = pl.nread;
+	atomic_store_explicit(&pl.eof, true, memory_order_release);
+
+	for (int i = 0; i < nthreads; i++)
+		pthread_join(cthrds[i], NULL);
+	pthread_join(wthrd, NULL);
+
+	for (int i = 0; i < nthreads; i++) {
+		for (size_t k = 0; k < RINGSZ; k++)
+			free(pl.rings[i].jobs[k].ext);
+	}
+	free(cthrds);
+	free(pl.rings);
+	return pl.total;
+}
+
+void
+push(const char *s, size_t n)
+{
+	struct ring *r = pl.rings + pl.nread / BATCHSZ % (size_t)pl.nthreads;
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	struct spin b = {0};
+	while (head - atomic_load_explicit(&r->tail, memory_order_acquire)
+	       == RINGSZ)
+	{
+		backoff(&b);
+	}
+
+	struct job *j = r->jobs + head % RINGSZ;
+	if (n > UINT32_MAX)
+		errx(1, "line too long");
+	j->n = (uint32_t)n;
+	if (n <= SECMAX) {
+		memcpy(j->sec, s, n);
+		j->s = j->sec;
+	} else {
+		if (j->extcap < n) {
+			if ((j->ext = realloc(j->ext, n)) == NULL)
+				err(1, "realloc");
+			j->extcap = (uint32_t)n;
+		}
+		memcpy(j->ext, s, n);
+		j->s = j->ext;
+	}
+
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+	pl.nread++;
+}
+
+void *
+compute(void *arg)
+{
+	struct ring *r = arg;
+	size_t mid = 0;
+	fmtcfg_t cfg = *pl.cfg;
+
+	dedup_t _dd, *dd = NULL;
+	if (cfg.dedup != 0)
+		dedup_init(dd = &_dd, cfg.dedup, cfg.lax);
+
+	for (;;) {
+		struct spin b = {0};
+		size_t head;
+		while ((head = atomic_load_explicit(&r->head, memory_order_acquire))
+		       == mid)
+		{
+			if (atomic_load_explicit(&pl.eof, memory_order_acquire)
+			 && atomic_load_explicit(&r->head, memory_order_acquire) == mid)
+			{
+				if (dd != NULL)
+					dedup_free(dd);
+				return NULL;
+			}
+			backoff(&b);
+		}
+
+		/* Process everything available in one go, publishing the
+		   whole batch at once */
+		cfg.now = (uint64_t)time(NULL);
+		if (dd == NULL) {
+			crunch(r, mid, head, &cfg);
+			mid = head;
+		}
+		for (; mid < head; mid++) {
+			struct job *j = r->jobs + mid % RINGSZ;
+			j->err = mkrecord(&j->rec, j->s, j->n, &cfg, dd);
+		}
+		atomic_store_explicit(&r->mid, mid, memory_order_release);
+	}
+}
+
+/* Compute the records of the jobs FROM to TO of R.  Secrets short enough
+   to be batched are gathered B32BATCH at a time and decoded together
+   straight into HMAC key blocks; the rest are decoded one by one. */
+void
+crunch(struct ring *r, size_t from, size_t to, const fmtcfg_t *cfg)
+{
+	while (from < to) {
+		struct job *js[B32BATCH];
+		const char *secs[B32BATCH];
+		size_t lens[B32BATCH], n = 0;
+		hmac_sha1_key_t key;
+
+		for (; from < to && n < B32BATCH; from++) {
+			struct job *j = r->jobs + from % RINGSZ;
+			fields_t *f = &j->rec.f;
+			if ((j->err = parsefields(f, j->s, j->n, cfg)) != KEYOK)
+				continue;
+
+			size_t len = f->secn;
+			while (len > 0 && f->sec[len - 1] == '=')
+				len--;
+			/* b32batch() only decodes strictly */
+			if (cfg->lax || len == 0 || len > B32BATCHLEN) {
+				j->err = b32key(&key, f->sec, f->secn, cfg->lax);
+				if (j->err == KEYOK)
+					mkcode(&j->rec, &key, cfg);
+				continue;
+			}
+
+			js[n] = j;
+			secs[n] = f->sec;
+			lens[n++] = len;
+		}
+
+		uint8_t blks[B32BATCH][B32KEYBLK];
+		uint32_t bad = b32batch(blks, secs, lens, n);
+		for (size_t k = 0; k < n; k++) {
+			if (bad >> k & 1) {
+				js[k]->err = KEYINVAL;
+				continue;
+			}
+			hmac_sha1keyblk(&key, blks[k]);
+			mkcode(&js[k]->rec, &key, cfg);
+		}
+	}
+}
+
+void *
+writer(void *arg)
+{
+	(void)arg;
+	size_t *tails = calloc((size_t)pl.nthreads, sizeof(*tails));
+	if (tails == NULL)
+		err(1, "calloc");
+
+	size_t bufsz = FMTSZ(SECMAX), n;
+	char *buf = malloc(bufsz);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	for (size_t k = 0;; k++) {
+		struct ring *r = pl.rings + k / BATCHSZ % (size_t)pl.nthreads;
+		size_t *tail = tails + (r - pl.rings);
+
+		struct spin b = {0};
+		while (atomic_load_explicit(&r->mid, memory_order_acquire) == *tail) {
+			if (atomic_load_explicit(&pl.eof, memory_order_acquire)
+			 && k == pl.total)
+			{
+				goto out;
+			}
+
+			/* Nothing to do, so make sure everything written so far
+			   reaches the consumer before we wait */
+			if (b.n == 0 && fflush(stdout) == EOF)
+				err(1, "fflush");
+			backoff(&b);
+		}
+
+		struct job *j = r->jobs + *tail % RINGSZ;
+		if (bufsz < FMTSZ(j->n)) {
+			bufsz = FMTSZ(j->n);
+			if ((buf = realloc(buf, bufsz)) == NULL)
+				err(1, "realloc");
+		}
+
+		if (j->err == KEYOK)
+			n = (size_t)(fmtrecord(buf, &j->rec, pl.cfg) - buf);
+		else {
+			if (fflush(stdout) == EOF)
+				err(1, "fflush");
+			pl.onerr(k + 1, j->err, j->s, j->n);
+			n = (size_t)(fmtbad(buf, j->s, j->n, pl.cfg) - buf);
+		}
+		if (fwrite(buf, 1, n, stdout) != n)
+			err(1, "fwrite");
+
+		atomic_store_explicit(&r->tail, ++*tail, memory_order_release);
+	}
+
+out:
+	if (fflush(stdout) == EOF)
+		err(1, "fflush");
+	free(buf);
+	free(tails);
+	return NULL;
+}
+
+/* Wait for another stage to make progress: spin briefly, then yield,
+   then sleep for exponentially longer up to a millisecond */
+void
+backoff(struct spin *b)
+{
+	if (b->n < 64)
+		cpurelax();
+	else if (b->n < 128)
+		sched_yield();
+	else {
+		unsigned shift = b->n - 128 < 10 ? b->n - 128 : 10;
+		struct timespec ts = {.tv_nsec = 1000L << shift};
+		nanosleep(&ts, NULL);
+	}
+	b->n++;
+}
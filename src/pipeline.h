@@ -0,0 +1,9 @@
+#ifndef TOTP_PIPELINE_H
+#define TOTP_PIPELINE_H
+
+#include "fmt.h"
+
+size_t pipeline_run(const char *, int, const fmtcfg_t *,
+                  void (*)(size_t, int, const char *, size_t));
+
+#endif /* !TOTP_PIPELINE_H */
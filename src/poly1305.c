@@ -0,0 +1,159 @@
+#include <string.h>
+
+#include "common.h"
+#include "poly1305.h"
+#include "xendian.h"
+
+#define MASK26 (0x3FFFFFF)
+
+static void blocks(poly1305_t *, const uint8_t *, size_t, uint32_t);
+static inline uint32_t ld32(const uint8_t *)
+	__attribute__((always_inline, pure));
+
+/* Poly1305 as described in RFC 8439 section 2.5, with the 32-bit limbs
+   of Andrew Moon’s poly1305-donna so that no 128-bit arithmetic is
+   needed */
+void
+poly1305init(poly1305_t *p, const uint8_t key[static POLY1305KEYSZ])
+{
+	/* r is clamped as it is loaded */
+	p->r[0] = (ld32(key +  0) >> 0) & 0x3FFFFFF;
+	p->r[1] = (ld32(key +  3) >> 2) & 0x3FFFF03;
+	p->r[2] = (ld32(key +  6) >> 4) & 0x3FFC0FF;
+	p->r[3] = (ld32(key +  9) >> 6) & 0x3F03FFF;
+	p->r[4] = (ld32(key + 12) >> 8) & 0x00FFFFF;
+	for (int i = 0; i < 4; i++)
+		p->pad[i] = ld32(key + 16 + i*4);
+	memset(p->h, 0, sizeof(p->h));
+	p->bufsz = 0;
+}
+
+void
+poly1305hash(poly1305_t *p, const uint8_t *msg, size_t n)
+{
+	if (p->bufsz != 0) {
+		size_t m = sizeof(p->buf) - p->bufsz;
+		if (m > n)
+			m = n;
+		memcpy(p->buf + p->bufsz, msg, m);
+		p->bufsz += m;
+		msg += m;
+		n -= m;
+		if (p->bufsz < sizeof(p->buf))
+			return;
+		blocks(p, p->buf, sizeof(p->buf), 1 << 24);
+		p->bufsz = 0;
+	}
+
+	size_t m = n & ~(size_t)15;
+	blocks(p, msg, m, 1 << 24);
+	memcpy(p->buf, msg + m, n - m);
+	p->bufsz = n - m;
+}
+
+void
+poly1305end(poly1305_t *p, uint8_t tag[static POLY1305TAGSZ])
+{
+	/* A final partial block is padded with a one and then zeros, and
+	   so doesn’t get the 2¹²⁸ bit */
+	if (p->bufsz != 0) {
+		p->buf[p->bufsz] = 1;
+		memset(p->buf + p->bufsz + 1, 0, sizeof(p->buf) - p->bufsz - 1);
+		blocks(p, p->buf, sizeof(p->buf), 0);
+	}
+
+	uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3],
+	         h4 = p->h[4], c;
+	c = h1 >> 26; h1 &= MASK26; h2 += c;
+	c = h2 >> 26; h2 &= MASK26; h3 += c;
+	c = h3 >> 26; h3 &= MASK26; h4 += c;
+	c = h4 >> 26; h4 &= MASK26; h0 += c * 5;
+	c = h0 >> 26; h0 &= MASK26; h1 += c;
+
+	/* Compute h − p and keep it if it didn’t go negative, without
+	   branching on h */
+	uint32_t g0, g1, g2, g3, g4;
+	g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26;
+	g1 = h1 + c; c = g1 >> 26; g1 &= MASK26;
+	g2 = h2 + c; c = g2 >> 26; g2 &= MASK26;
+	g3 = h3 + c; c = g3 >> 26; g3 &= MASK26;
+	g4 = h4 + c - (1 << 26);
+
+	uint32_t keep = (g4 >> 31) - 1;
+	h0 = (h0 & ~keep) | (g0 & keep);
+	h1 = (h1 & ~keep) | (g1 & keep);
+	h2 = (h2 & ~keep) | (g2 & keep);
+	h3 = (h3 & ~keep) | (g3 & keep);
+	h4 = (h4 & ~keep) | (g4 & keep);
+
+	/* Back to radix 2³², mod 2¹²⁸, plus the pad */
+	uint32_t w[4] = {
+		h0       | h1 << 26,
+		h1 >>  6 | h2 << 20,
+		h2 >> 12 | h3 << 14,
+		h3 >> 18 | h4 <<  8,
+	};
+	uint64_t f = 0;
+	for (int i = 0; i < 4; i++) {
+		f = (uint64_t)w[i] + p->pad[i] + (f >> 32);
+		uint32_t x = htole32((uint32_t)f);
+		memcpy(tag + i*4, &x, 4);
+	}
+
+	memset(p, 0, sizeof(*p));
+}
+
+/* Absorb the N bytes at MSG, a multiple of 16, adding HIBIT to each
+   block’s top limb */
+void
+blocks(poly1305_t *p, const uint8_t *msg, size_t n, uint32_t hibit)
+{
+	const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3],
+	               r4 = p->r[4];
+	const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+	uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3],
+	         h4 = p->h[4];
+
+	for (; n >= 16; msg += 16, n -= 16) {
+		h0 += (ld32(msg +  0) >> 0) & MASK26;
+		h1 += (ld32(msg +  3) >> 2) & MASK26;
+		h2 += (ld32(msg +  6) >> 4) & MASK26;
+		h3 += (ld32(msg +  9) >> 6) & MASK26;
+		h4 += (ld32(msg + 12) >> 8) | hibit;
+
+		uint64_t d0, d1, d2, d3, d4;
+		d0 = (uint64_t)h0*r0 + (uint64_t)h1*s4 + (uint64_t)h2*s3
+		   + (uint64_t)h3*s2 + (uint64_t)h4*s1;
+		d1 = (uint64_t)h0*r1 + (uint64_t)h1*r0 + (uint64_t)h2*s4
+		   + (uint64_t)h3*s3 + (uint64_t)h4*s2;
+		d2 = (uint64_t)h0*r2 + (uint64_t)h1*r1 + (uint64_t)h2*r0
+		   + (uint64_t)h3*s4 + (uint64_t)h4*s3;
+		d3 = (uint64_t)h0*r3 + (uint64_t)h1*r2 + (uint64_t)h2*r1
+		   + (uint64_t)h3*r0 + (uint64_t)h4*s4;
+		d4 = (uint64_t)h0*r4 + (uint64_t)h1*r3 + (uint64_t)h2*r2
+		   + (uint64_t)h3*r1 + (uint64_t)h4*r0;
+
+		uint32_t c;
+		c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & MASK26;
+		d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & MASK26;
+		d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & MASK26;
+		d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & MASK26;
+		d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & MASK26;
+		h0 += c * 5; c = h0 >> 26; h0 &= MASK26;
+		h1 += c;
+	}
+
+	p->h[0] = h0;
+	p->h[1] = h1;
+	p->h[2] = h2;
+	p->h[3] = h3;
+	p->h[4] = h4;
+}
+
+uint32_t
+ld32(const uint8_t *p)
+{
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return le32toh(x);
+}
@@ -0,0 +1,21 @@
+#ifndef TOTP_POLY1305_H
+#define TOTP_POLY1305_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POLY1305KEYSZ (32)
+#define POLY1305TAGSZ (16)
+
+/* The accumulator and key in radix 2²⁶, as in poly1305-donna */
+typedef struct {
+	uint32_t r[5], h[5], pad[4];
+	uint8_t buf[16];
+	size_t bufsz;
+} poly1305_t;
+
+void poly1305init(poly1305_t *, const uint8_t [static POLY1305KEYSZ]);
+void poly1305hash(poly1305_t *, const uint8_t *, size_t);
+void poly1305end(poly1305_t *, uint8_t [static POLY1305TAGSZ]);
+
+#endif /* !TOTP_POLY1305_H */
@@ -0,0 +1,773 @@
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "qr.h"
+
+/* Modules of light border around rendered symbols */
+#define QUIET (4)
+
+/* Pixels per module in PBM and PNG output */
+#define SCALE (4)
+
+/* Most error correction codewords in a block */
+#define ECCMAX (30)
+
+/* Largest stored deflate block */
+#define ZBLKMAX (65535)
+
+#define MOD(q, x, y) ((q)->mods[(y) * (q)->size + (x)])
+#define FN(q, x, y)  ((q)->fn[(y) * (q)->size + (x)])
+
+/* A zlib stream of stored blocks; TOTAL is the bytes yet to be written
+   and LEFT those that still fit in the current block */
+struct zstream {
+	uint8_t *p;
+	size_t total, left;
+	uint32_t a, b;
+};
+
+static void interleave(qr_t *);
+static void drawfn(qr_t *);
+static void drawfinder(qr_t *, int, int);
+static void drawalign(qr_t *, int, int);
+static void drawformat(qr_t *, int);
+static void place(qr_t *);
+static void applymask(qr_t *, int);
+static long penalty(const qr_t *);
+static char *rendertext(qr_t *, size_t *);
+static char *rendersvg(qr_t *, size_t *);
+static char *renderpbm(qr_t *, size_t *);
+static char *renderpng(qr_t *, size_t *);
+static void pxrow(const qr_t *, uint8_t *, int, bool);
+static void zwrite(struct zstream *, const uint8_t *, size_t);
+static uint8_t *chunk(uint8_t *, const char *, size_t);
+static uint32_t crc32(uint32_t, const uint8_t *, size_t)
+	__attribute__((pure));
+static char *ensure(qr_t *, size_t);
+static char *utoa(char *, unsigned);
+static uint8_t *be32(uint8_t *, uint32_t);
+static size_t rawcws(int)
+	__attribute__((const));
+static inline bool maskbit(int, int, int)
+	__attribute__((always_inline, const));
+
+/* Error correction codewords per block and number of blocks by level
+   and version, from ISO/IEC 18004 table 9 */
+static const uint8_t eccpb[4][QRVERMAX + 1] = {
+	{0,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28,
+	 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30,
+	 30, 30, 30, 30, 30},
+	{0, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28,
+	 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	 28, 28, 28, 28, 28},
+	{0, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28,
+	 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30,
+	 30, 30, 30, 30, 30},
+	{0, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28,
+	 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30,
+	 30, 30, 30, 30, 30},
+};
+static const uint8_t nblocks[4][QRVERMAX + 1] = {
+	{0,  1,  1,  1,  1,  1,  2,  2,  2,  2,  4,  4,  4,  4,  4,  6,  6,  6,
+	  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19,
+	 20, 21, 22, 24, 25},
+	{0,  1,  1,  1,  2,  2,  4,  4,  4,  5,  5,  5,  8,  9,  9, 10, 10, 11,
+	 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38,
+	 40, 43, 45, 47, 49},
+	{0,  1,  1,  2,  2,  4,  4,  6,  6,  8,  8,  8, 10, 12, 16, 12, 17, 16,
+	 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53,
+	 56, 59, 62, 65, 68},
+	{0,  1,  1,  2,  4,  4,  4,  5,  6,  8,  8, 11, 11, 16, 16, 18, 16, 19,
+	 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63,
+	 66, 70, 74, 77, 81},
+};
+
+/* The format information bits of each level */
+static const uint8_t eccbits[] = {1, 0, 3, 2};
+
+/* GF(2⁸) modulo x⁸ + x⁴ + x³ + x² + 1 as log and antilog tables, the
+   latter doubled so that a product needs no reduction modulo 255 */
+static uint8_t gfexp[510], gflog[256];
+
+/* The logs of the coefficients of the Reed-Solomon generator polynomial
+   of each degree, highest first and without the leading 1 */
+static uint8_t genlog[ECCMAX + 1][ECCMAX];
+
+static uint32_t crctab[256];
+
+void
+qr_init(qr_t *q)
+{
+	static bool tables;
+
+	q->out = NULL;
+	q->outcap = 0;
+	if (tables)
+		return;
+	tables = true;
+
+	for (int i = 0, x = 1; i < 255; i++) {
+		gfexp[i] = gfexp[i + 255] = (uint8_t)x;
+		gflog[x] = (uint8_t)i;
+		x <<= 1;
+		if (x & 0x100)
+			x ^= 0x11D;
+	}
+
+	/* The generator of degree N is (x − α⁰)(x − α¹)…(x − αᴺ⁻¹).  Its
+	   coefficients are never zero, so they all have logs. */
+	for (int n = 1; n <= ECCMAX; n++) {
+		uint8_t g[ECCMAX] = {0};
+		g[n - 1] = 1;
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) {
+				g[j] = g[j] != 0 ? gfexp[gflog[g[j]] + i] : 0;
+				if (j + 1 < n)
+					g[j] ^= g[j + 1];
+			}
+		}
+		for (int j = 0; j < n; j++)
+			genlog[n][j] = gflog[g[j]];
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++)
+			c = c & 1 ? 0xEDB88320 ^ c >> 1 : c >> 1;
+		crctab[i] = c;
+	}
+}
+
+void
+qr_free(qr_t *q)
+{
+	free(q->out);
+}
+
+/* Encode the N bytes at S into Q in byte mode at the error correction
+   level ECC, in the smallest version they fit in.  Returns false if they
+   don’t fit in any. */
+bool
+qr_encode(qr_t *q, const uint8_t *s, size_t n, int ecc)
+{
+	int v;
+	size_t cap = 0;
+	for (v = 1; v <= QRVERMAX; v++) {
+		cap = rawcws(v) - (size_t)eccpb[ecc][v] * nblocks[ecc][v];
+		if (4 + (v < 10 ? 8 : 16) + n * 8 <= cap * 8)
+			break;
+	}
+	if (v > QRVERMAX)
+		return false;
+	q->version = v;
+	q->size = 17 + 4 * v;
+	q->ecc = ecc;
+
+	/* The mode indicator 0100 and the count put the data 4 bits into a
+	   byte, and the 4-bit terminator then ends on a byte boundary.  The
+	   rest is padded with alternating 0xEC and 0x11. */
+	uint8_t *d = q->data;
+	size_t off;
+	if (v < 10) {
+		d[0] = (uint8_t)(0x40 | n >> 4);
+		off = 1;
+	} else {
+		d[0] = (uint8_t)(0x40 | n >> 12);
+		d[1] = (uint8_t)(n >> 4);
+		off = 2;
+	}
+	d[off] = (uint8_t)(n << 4);
+	for (size_t i = 0; i < n; i++) {
+		d[off + i] |= s[i] >> 4;
+		d[off + i + 1] = (uint8_t)(s[i] << 4);
+	}
+	for (size_t i = off + n + 1; i < cap; i++)
+		d[i] = (i - off - n - 1) & 1 ? 0x11 : 0xEC;
+
+	interleave(q);
+	drawfn(q);
+	place(q);
+
+	long best = 0;
+	for (int m = 0; m < 8; m++) {
+		applymask(q, m);
+		drawformat(q, m);
+		long p = penalty(q);
+		if (m == 0 || p < best) {
+			best = p;
+			q->mask = m;
+		}
+		applymask(q, m);
+	}
+	applymask(q, q->mask);
+	drawformat(q, q->mask);
+	return true;
+}
+
+/* Split the data codewords into blocks, append the error correction
+   codewords of each, and interleave them all into CWS.  Blocks differ in
+   length by at most one data codeword; the short ones come first. */
+void
+interleave(qr_t *q)
+{
+	int nb = nblocks[q->ecc][q->version], ecl = eccpb[q->ecc][q->version];
+	size_t raw = rawcws(q->version);
+	size_t nshort = (size_t)nb - raw % (size_t)nb;
+	size_t shortlen = raw / (size_t)nb - (size_t)ecl;
+	uint8_t ecc[QRCWMAX], *cws = q->cws;
+	const uint8_t *g = genlog[ecl];
+
+	for (size_t j = 0, start = 0; j < (size_t)nb; j++) {
+		size_t len = shortlen + (j >= nshort);
+		uint8_t *r = ecc + j * (size_t)ecl;
+
+		/* Polynomial division by the generator, one table lookup per
+		   coefficient */
+		memset(r, 0, (size_t)ecl);
+		for (size_t i = 0; i < len; i++) {
+			uint8_t f = q->data[start + i] ^ r[0];
+			memmove(r, r + 1, (size_t)ecl - 1);
+			r[ecl - 1] = 0;
+			if (f != 0) {
+				int lf = gflog[f];
+				for (int k = 0; k < ecl; k++)
+					r[k] ^= gfexp[g[k] + lf];
+			}
+		}
+		start += len;
+	}
+
+	size_t k = 0;
+	for (size_t i = 0; i <= shortlen; i++) {
+		for (size_t j = 0; j < (size_t)nb; j++) {
+			if (i == shortlen && j < nshort)
+				continue;
+			cws[k++] = q->data[j * shortlen + (j > nshort ? j - nshort : 0) + i];
+		}
+	}
+	for (int i = 0; i < ecl; i++) {
+		for (int j = 0; j < nb; j++)
+			cws[k++] = ecc[j * ecl + i];
+	}
+}
+
+/* Draw the finder, timing, and alignment patterns, the version
+   information, and placeholder format information, marking them all as
+   function modules */
+void
+drawfn(qr_t *q)
+{
+	int n = q->size, v = q->version;
+	memset(q->mods, 0, (size_t)(n * n));
+	memset(q->fn, 0, (size_t)(n * n));
+
+	for (int i = 0; i < n; i++) {
+		MOD(q, 6, i) = MOD(q, i, 6) = i % 2 == 0;
+		FN(q, 6, i) = FN(q, i, 6) = 1;
+	}
+
+	drawfinder(q, 3, 3);
+	drawfinder(q, n - 4, 3);
+	drawfinder(q, 3, n - 4);
+
+	if (v > 1) {
+		int na = v / 7 + 2, pos[7];
+		int step = v == 32 ? 26 : (v * 4 + na * 2 + 1) / (na * 2 - 2) * 2;
+		pos[0] = 6;
+		for (int i = na - 1, p = n - 7; i >= 1; i--, p -= step)
+			pos[i] = p;
+		for (int i = 0; i < na; i++) {
+			for (int j = 0; j < na; j++) {
+				/* Not over the finders */
+				if ((i == 0 && j == 0) || (i == 0 && j == na - 1)
+				 || (i == na - 1 && j == 0))
+				{
+					continue;
+				}
+				drawalign(q, pos[i], pos[j]);
+			}
+		}
+	}
+
+	drawformat(q, 0);
+
+	if (v >= 7) {
+		uint32_t r = (uint32_t)v;
+		for (int i = 0; i < 12; i++)
+			r = r << 1 ^ (r >> 11) * 0x1F25;
+		uint32_t bits = (uint32_t)v << 12 | r;
+		/* Both blocks start 11 modules from the far edge */
+		for (int i = 0; i < 18; i++) {
+			int a = 4 * v + 6 + i % 3, b = i / 3;
+			MOD(q, a, b) = MOD(q, b, a) = bits >> i & 1;
+			FN(q, a, b) = FN(q, b, a) = 1;
+		}
+	}
+}
+
+/* A finder centred on X, Y along with its separator */
+void
+drawfinder(qr_t *q, int x, int y)
+{
+	for (int dy = -4; dy <= 4; dy++) {
+		for (int dx = -4; dx <= 4; dx++) {
+			int xx = x + dx, yy = y + dy;
+			if (xx < 0 || xx >= q->size || yy < 0 || yy >= q->size)
+				continue;
+			int d = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+			MOD(q, xx, yy) = d != 2 && d != 4;
+			FN(q, xx, yy) = 1;
+		}
+	}
+}
+
+void
+drawalign(qr_t *q, int x, int y)
+{
+	for (int dy = -2; dy <= 2; dy++) {
+		for (int dx = -2; dx <= 2; dx++) {
+			int d = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+			MOD(q, x + dx, y + dy) = d != 1;
+			FN(q, x + dx, y + dy) = 1;
+		}
+	}
+}
+
+/* Draw both copies of the format information for MASK, and the dark
+   module beside them */
+void
+drawformat(qr_t *q, int mask)
+{
+	int n = q->size;
+	uint32_t d = (uint32_t)eccbits[q->ecc] << 3 | (uint32_t)mask, r = d;
+	for (int i = 0; i < 10; i++)
+		r = r << 1 ^ (r >> 9) * 0x537;
+	uint32_t bits = (d << 10 | r) ^ 0x5412;
+
+#define SET(x, y, i) (MOD(q, x, y) = bits >> (i) & 1, FN(q, x, y) = 1)
+	for (int i = 0; i < 6; i++)
+		SET(8, i, i);
+	SET(8, 7, 6);
+	SET(8, 8, 7);
+	SET(7, 8, 8);
+	for (int i = 9; i < 15; i++)
+		SET(14 - i, 8, i);
+
+	for (int i = 0; i < 8; i++)
+		SET(n - 1 - i, 8, i);
+	for (int i = 8; i < 15; i++)
+		SET(8, n - 15 + i, i);
+#undef SET
+	MOD(q, 8, n - 8) = 1;
+	FN(q, 8, n - 8) = 1;
+}
+
+/* Lay the codewords out in the zigzag of two-module columns, right to
+   left, skipping the vertical timing pattern.  Remainder bits are left
+   light. */
+void
+place(qr_t *q)
+{
+	int n = q->size;
+	size_t i = 0, nbits = rawcws(q->version) * 8;
+	for (int right = n - 1; right >= 1; right -= 2) {
+		if (right == 6)
+			right = 5;
+		bool up = ((right + 1) & 2) == 0;
+		for (int k = 0; k < n; k++) {
+			int y = up ? n - 1 - k : k;
+			for (int j = 0; j < 2; j++) {
+				int x = right - j;
+				if (FN(q, x, y) || i >= nbits)
+					continue;
+				MOD(q, x, y) = q->cws[i >> 3] >> (7 - (i & 7)) & 1;
+				i++;
+			}
+		}
+	}
+}
+
+void
+applymask(qr_t *q, int m)
+{
+	for (int y = 0; y < q->size; y++) {
+		for (int x = 0; x < q->size; x++) {
+			if (!FN(q, x, y))
+				MOD(q, x, y) ^= maskbit(m, x, y);
+		}
+	}
+}
+
+/* Score Q by the four penalty rules of ISO/IEC 18004 section 7.8.3: runs
+   of five or more modules of a colour, 2×2 blocks of a colour, finder-like
+   1:1:3:1:1 patterns with four light modules to a side, and imbalance
+   between dark and light.  Lower is better.  Modules past the edge count
+   as light. */
+long
+penalty(const qr_t *q)
+{
+	int n = q->size;
+	long p = 0, dark = 0;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (int a = 0; a < n; a++) {
+#define AT(b) (pass == 0 ? MOD(q, b, a) : MOD(q, a, b))
+			int run = 0, c = -1;
+			for (int b = 0; b < n; b++) {
+				if (AT(b) == c)
+					run++;
+				else {
+					if (run >= 5)
+						p += run - 2;
+					c = AT(b);
+					run = 1;
+				}
+			}
+			if (run >= 5)
+				p += run - 2;
+
+			for (int b = 0; b + 7 <= n; b++) {
+				if (!AT(b) || AT(b + 1) || !AT(b + 2) || !AT(b + 3)
+				 || !AT(b + 4) || AT(b + 5) || !AT(b + 6))
+				{
+					continue;
+				}
+				bool before = true, after = true;
+				for (int k = 1; k <= 4; k++) {
+					if (b - k >= 0 && AT(b - k))
+						before = false;
+					if (b + 6 + k < n && AT(b + 6 + k))
+						after = false;
+				}
+				p += 40 * (before + after);
+			}
+#undef AT
+		}
+	}
+
+	for (int y = 0; y < n; y++) {
+		for (int x = 0; x < n; x++) {
+			uint8_t c = MOD(q, x, y);
+			dark += c;
+			if (x + 1 < n && y + 1 < n && c == MOD(q, x + 1, y)
+			 && c == MOD(q, x, y + 1) && c == MOD(q, x + 1, y + 1))
+			{
+				p += 3;
+			}
+		}
+	}
+
+	long total = (long)n * n;
+	p += 10 * (labs(dark * 20 - total * 10) / total);
+	return p;
+}
+
+/* Render the encoded symbol Q in the format FMT, returning a buffer owned
+   by Q and storing its length in N */
+const char *
+qr_render(qr_t *q, int fmt, size_t *n)
+{
+	switch (fmt) {
+	case QRSVG:
+		return rendersvg(q, n);
+	case QRPBM:
+		return renderpbm(q, n);
+	case QRPNG:
+		return renderpng(q, n);
+	default:
+		return rendertext(q, n);
+	}
+}
+
+/* Two rows of modules to a line of half blocks.  Light modules are drawn
+   and dark ones left blank, which reads correctly on the usual light on
+   dark terminal. */
+char *
+rendertext(qr_t *q, size_t *n)
+{
+	int w = q->size + 2 * QUIET;
+	char *buf = ensure(q, (size_t)((w * 3 + 1) * ((w + 1) / 2))), *p = buf;
+
+	for (int y = 0; y < w; y += 2) {
+		for (int x = 0; x < w; x++) {
+			int mx = x - QUIET, my = y - QUIET;
+			bool in = mx >= 0 && mx < q->size;
+			bool top = in && my >= 0 && my < q->size && MOD(q, mx, my),
+			     bot = y + 1 >= w
+			         || (in && my + 1 >= 0 && my + 1 < q->size
+			             && MOD(q, mx, my + 1));
+			if (top && bot)
+				*p++ = ' ';
+			else {
+				*p++ = (char)0xE2;
+				*p++ = (char)0x96;
+				*p++ = (char)(top ? 0x84 : bot ? 0x80 : 0x88);
+			}
+		}
+		*p++ = '\n';
+	}
+
+	*n = (size_t)(p - buf);
+	return buf;
+}
+
+/* One path of horizontal runs of dark modules */
+char *
+rendersvg(qr_t *q, size_t *n)
+{
+	static const char head[] =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" "
+		"viewBox=\"0 0 ";
+	static const char body[] =
+		"\" stroke=\"none\">\n"
+		"<rect width=\"100%\" height=\"100%\" fill=\"#FFFFFF\"/>\n"
+		"<path d=\"";
+	static const char tail[] = "\" fill=\"#000000\"/>\n</svg>\n";
+
+	unsigned w = (unsigned)(q->size + 2 * QUIET);
+	size_t runs = (size_t)q->size * (size_t)((q->size + 1) / 2);
+	char *buf = ensure(q, sizeof(head) + sizeof(body) + sizeof(tail) + 16
+	                      + runs * sizeof("M000,000h000v1h-000z")),
+	     *p = buf;
+
+	memcpy(p, head, sizeof(head) - 1);
+	p += sizeof(head) - 1;
+	p = utoa(p, w);
+	*p++ = ' ';
+	p = utoa(p, w);
+	memcpy(p, body, sizeof(body) - 1);
+	p += sizeof(body) - 1;
+
+	for (int y = 0; y < q->size; y++) {
+		for (int x = 0; x < q->size;) {
+			if (!MOD(q, x, y)) {
+				x++;
+				continue;
+			}
+			int x0 = x;
+			while (x < q->size && MOD(q, x, y))
+				x++;
+			unsigned len = (unsigned)(x - x0);
+			*p++ = 'M';
+			p = utoa(p, (unsigned)(x0 + QUIET));
+			*p++ = ',';
+			p = utoa(p, (unsigned)(y + QUIET));
+			*p++ = 'h';
+			p = utoa(p, len);
+			memcpy(p, "v1h-", 4);
+			p = utoa(p + 4, len);
+			*p++ = 'z';
+		}
+	}
+
+	memcpy(p, tail, sizeof(tail) - 1);
+	p += sizeof(tail) - 1;
+	*n = (size_t)(p - buf);
+	return buf;
+}
+
+/* A raw PBM, SCALE pixels to a module */
+char *
+renderpbm(qr_t *q, size_t *n)
+{
+	unsigned w = (unsigned)(q->size + 2 * QUIET) * SCALE;
+	size_t rowsz = (w + 7) / 8;
+	char *buf = ensure(q, 32 + rowsz * w), *p = buf;
+
+	memcpy(p, "P4\n", 3);
+	p = utoa(p + 3, w);
+	*p++ = ' ';
+	p = utoa(p, w);
+	*p++ = '\n';
+
+	for (unsigned y = 0; y < w; y += SCALE) {
+		pxrow(q, (uint8_t *)p, (int)(y / SCALE) - QUIET, true);
+		for (int k = 1; k < SCALE; k++)
+			memcpy(p + k * rowsz, p, rowsz);
+		p += SCALE * rowsz;
+	}
+
+	*n = (size_t)(p - buf);
+	return buf;
+}
+
+/* A 1-bit greyscale PNG, SCALE pixels to a module.  The image data is
+   written as stored deflate blocks: the symbols are tiny and compressing
+   them would cost far more than it saves. */
+char *
+renderpng(qr_t *q, size_t *n)
+{
+	static const uint8_t sig[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+	uint32_t w = (uint32_t)(q->size + 2 * QUIET) * SCALE;
+	size_t rowsz = 1 + (w + 7) / 8, rawsz = rowsz * w;
+	size_t nblk = (rawsz + ZBLKMAX - 1) / ZBLKMAX;
+	uint8_t *buf = (uint8_t *)ensure(q, sizeof(sig) + 25 + 12 + 2 + rawsz
+	                                    + 5 * nblk + 4 + 12),
+	        *p = buf;
+
+	memcpy(p, sig, sizeof(sig));
+	p += sizeof(sig);
+
+	uint8_t *c = p + 8;
+	c = be32(c, w);
+	c = be32(c, w);
+	memcpy(c, "\1\0\0\0\0", 5);
+	p = chunk(p, "IHDR", 13);
+
+	uint8_t *d = p + 8;
+	*d++ = 0x78;
+	*d++ = 0x01;
+	struct zstream z = {.p = d, .total = rawsz, .a = 1};
+	uint8_t row[1 + ((QRSIZEMAX + 2 * QUIET) * SCALE + 7) / 8];
+	for (uint32_t y = 0; y < w; y += SCALE) {
+		row[0] = 0;
+		pxrow(q, row + 1, (int)(y / SCALE) - QUIET, false);
+		for (int k = 0; k < SCALE; k++)
+			zwrite(&z, row, rowsz);
+	}
+	z.p = be32(z.p, z.b << 16 | z.a);
+	p = chunk(p, "IDAT", (size_t)(z.p - (p + 8)));
+
+	p = chunk(p, "IEND", 0);
+	*n = (size_t)(p - buf);
+	return (char *)buf;
+}
+
+/* Pack module row Y of Q, with the quiet zone, SCALE bits per module
+   into DST, with DARK the value of a dark bit */
+void
+pxrow(const qr_t *q, uint8_t *dst, int y, bool dark)
+{
+	int w = (q->size + 2 * QUIET) * SCALE;
+	memset(dst, dark ? 0 : 0xFF, (size_t)(w + 7) / 8);
+	if (y < 0 || y >= q->size)
+		return;
+	for (int x = 0; x < q->size; x++) {
+		if (!MOD(q, x, y))
+			continue;
+		for (int k = 0; k < SCALE; k++) {
+			int px = (x + QUIET) * SCALE + k;
+			if (dark)
+				dst[px >> 3] |= (uint8_t)(0x80 >> (px & 7));
+			else
+				dst[px >> 3] &= (uint8_t)~(0x80 >> (px & 7));
+		}
+	}
+}
+
+/* Append the N bytes at S to the stored deflate stream Z, starting a
+   new block whenever the current one is full */
+void
+zwrite(struct zstream *z, const uint8_t *s, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		z->a = (z->a + s[i]) % 65521;
+		z->b = (z->b + z->a) % 65521;
+	}
+
+	while (n > 0) {
+		if (z->left == 0) {
+			z->left = z->total < ZBLKMAX ? z->total : ZBLKMAX;
+			z->p[0] = z->left == z->total;
+			z->p[1] = (uint8_t)z->left;
+			z->p[2] = (uint8_t)(z->left >> 8);
+			z->p[3] = (uint8_t)~z->left;
+			z->p[4] = (uint8_t)(~z->left >> 8);
+			z->p += 5;
+		}
+		size_t m = n < z->left ? n : z->left;
+		memcpy(z->p, s, m);
+		z->p += m;
+		z->left -= m;
+		z->total -= m;
+		s += m;
+		n -= m;
+	}
+}
+
+/* Wrap the N bytes of data already written 8 bytes past P in a chunk of
+   TYPE, returning the end of the chunk */
+uint8_t *
+chunk(uint8_t *p, const char *type, size_t n)
+{
+	be32(p, (uint32_t)n);
+	memcpy(p + 4, type, 4);
+	uint8_t *end = p + 8 + n;
+	return be32(end, ~crc32(UINT32_MAX, p + 4, n + 4));
+}
+
+uint32_t
+crc32(uint32_t c, const uint8_t *s, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		c = crctab[(c ^ s[i]) & 0xFF] ^ c >> 8;
+	return c;
+}
+
+char *
+ensure(qr_t *q, size_t n)
+{
+	if (q->outcap < n) {
+		q->outcap = n;
+		if ((q->out = realloc(q->out, n)) == NULL)
+			err(1, "realloc");
+	}
+	return q->out;
+}
+
+char *
+utoa(char *dst, unsigned x)
+{
+	char buf[16], *p = buf + sizeof(buf);
+	do
+		*--p = (char)('0' + x % 10);
+	while (x /= 10);
+	size_t n = (size_t)(buf + sizeof(buf) - p);
+	memcpy(dst, p, n);
+	return dst + n;
+}
+
+uint8_t *
+be32(uint8_t *p, uint32_t x)
+{
+	p[0] = (uint8_t)(x >> 24);
+	p[1] = (uint8_t)(x >> 16);
+	p[2] = (uint8_t)(x >> 8);
+	p[3] = (uint8_t)x;
+	return p + 4;
+}
+
+/* The codewords of a symbol of version V, data and error correction
+   alike: every module less the function patterns and version and format
+   information, in bytes */
+size_t
+rawcws(int v)
+{
+	size_t r = (size_t)((16 * v + 128) * v + 64);
+	if (v >= 2) {
+		int na = v / 7 + 2;
+		r -= (size_t)((25 * na - 10) * na - 55);
+		if (v >= 7)
+			r -= 36;
+	}
+	return r / 8;
+}
+
+bool
+maskbit(int m, int x, int y)
+{
+	switch (m) {
+	case 0:  return (x + y) % 2 == 0;
+	case 1:  return y % 2 == 0;
+	case 2:  return x % 3 == 0;
+	case 3:  return (x + y) % 3 == 0;
+	case 4:  return (x / 3 + y / 2) % 2 == 0;
+	case 5:  return x * y % 2 + x * y % 3 == 0;
+	case 6:  return (x * y % 2 + x * y % 3) % 2 == 0;
+	default: return ((x + y) % 2 + x * y % 3) % 2 == 0;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef TOTP_QR_H
+#define TOTP_QR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define QRVERMAX  (40)
+#define QRSIZEMAX (17 + 4 * QRVERMAX)
+
+/* Codewords in a version 40 symbol */
+#define QRCWMAX (3706)
+
+/* Error correction levels, recovering about 7%, 15%, 25%, and 30% of
+   the symbol respectively */
+enum {
+	QRECCL,
+	QRECCM,
+	QRECCQ,
+	QRECCH,
+};
+
+/* Output formats of qr_render() */
+enum {
+	QRNONE,
+	QRTEXT,
+	QRSVG,
+	QRPBM,
+	QRPNG,
+};
+
+/* A QR code symbol along with all the scratch space needed to encode and
+   render it, so that any number of symbols can be produced with no
+   allocations beyond growing OUT.  MODS holds one byte per module, 1 for
+   dark, row by row; FN marks the modules of the function patterns. */
+typedef struct {
+	int version, size, ecc, mask;
+	uint8_t mods[QRSIZEMAX * QRSIZEMAX], fn[QRSIZEMAX * QRSIZEMAX];
+	uint8_t data[QRCWMAX], cws[QRCWMAX];
+
+	/* Rendered output */
+	char *out;
+	size_t outcap;
+} qr_t;
+
+void qr_init(qr_t *);
+bool qr_encode(qr_t *, const uint8_t *, size_t, int);
+const char *qr_render(qr_t *, int, size_t *);
+void qr_free(qr_t *);
+
+#endif /* !TOTP_QR_H */
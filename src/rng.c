@@ -0,0 +1,64 @@
+#include <err.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#if __OpenBSD__
+#	define getrandom(p, n, flags) (getentropy(p, n) == 0 ? (ssize_t)(n) : -1)
+#else
+#	include <sys/random.h>
+#endif
+
+#include "chacha.h"
+#include "rng.h"
+
+static void refill(rng_t *);
+
+void
+rng_init(rng_t *r)
+{
+	for (size_t n = 0; n < sizeof(r->key);) {
+		ssize_t m = getrandom(r->key + n, sizeof(r->key) - n, 0);
+		if (m == -1 && errno != EINTR)
+			err(1, "getrandom");
+		if (m > 0)
+			n += (size_t)m;
+	}
+	r->off = sizeof(r->buf);
+}
+
+/* Fill the N bytes at P with random bytes.  Bytes are wiped from the
+   buffer as they are handed out. */
+void
+rng_fill(rng_t *r, void *p, size_t n)
+{
+	uint8_t *d = p;
+	while (n > 0) {
+		if (r->off == sizeof(r->buf))
+			refill(r);
+		size_t m = sizeof(r->buf) - r->off;
+		if (m > n)
+			m = n;
+		memcpy(d, r->buf + r->off, m);
+		memset(r->buf + r->off, 0, m);
+		r->off += m;
+		d += m;
+		n -= m;
+	}
+}
+
+void
+rng_free(rng_t *r)
+{
+	explicit_bzero(r, sizeof(*r));
+}
+
+void
+refill(rng_t *r)
+{
+	static const uint8_t nonce[CHACHANONCESZ];
+	chacha20(r->buf, r->key, nonce, 0, sizeof(r->buf) / CHACHABLKSZ);
+	memcpy(r->key, r->buf, sizeof(r->key));
+	memset(r->buf, 0, sizeof(r->key));
+	r->off = sizeof(r->key);
+}
@@ -0,0 +1,26 @@
+#ifndef TOTP_RNG_H
+#define TOTP_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chacha.h"
+
+/* Bytes of keystream generated per refill */
+#define RNGBUFSZ (64 * CHACHABLKSZ)
+
+/* A ChaCha20 keystream generator seeded once from the kernel.  Each
+   refill generates RNGBUFSZ bytes and immediately replaces the key with
+   the first CHACHAKEYSZ of them, so earlier output can’t be recovered
+   from the state (‘fast key erasure’). */
+typedef struct {
+	uint8_t key[CHACHAKEYSZ];
+	uint8_t buf[RNGBUFSZ];
+	size_t off;
+} rng_t;
+
+void rng_init(rng_t *);
+void rng_fill(rng_t *, void *, size_t);
+void rng_free(rng_t *);
+
+#endif /* !TOTP_RNG_H */
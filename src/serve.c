@@ -0,0 +1,209 @@
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "fmt.h"
+#include "hash.h"
+#include "input.h"
+#include "serve.h"
+#include "totp.h"
+#include "uri.h"
+
+/* Number of entries in the key cache; must be a power of two */
+#define CACHESZ (1024)
+
+#define ISSPACE(c) ((c) == ' ' || (c) == '\t')
+
+struct kcent {
+	char *s;
+	size_t n, cap;
+	bool valid;
+	hmac_sha1_key_t key;
+};
+
+static void respond(const char *, size_t);
+static void answer(const char *, size_t);
+static int getkey(const hmac_sha1_key_t **, const char *, size_t);
+static bool getnum(const char *, size_t, uint64_t *);
+static inline uint64_t hash(const char *, size_t)
+	__attribute__((always_inline, pure));
+
+static int ddigits, dperiod;
+static bool dlax;
+static struct kcent cache[CACHESZ];
+
+/* Act as a coprocess, answering one request per line of the standard
+   input with exactly one line on the standard output.  A request is a
+   secret optionally followed by space-separated ‘digits=N’, ‘period=N’,
+   and ‘time=N’ fields overriding DIGITS, PERIOD, and the current time.
+   The secret may also be an otpauth:// URI, and is decoded leniently
+   if LAX is true.
+   The response is either the code or a line beginning with ‘error: ’.
+   Keys are kept in a direct-mapped cache so that a repeated secret
+   only costs the HMAC of its counter. */
+void
+serve_stdio(int digits, int period, bool lax)
+{
+	ddigits = digits;
+	dperiod = period;
+	dlax = lax;
+	input_fd(STDIN_FILENO, respond);
+}
+
+void
+respond(const char *s, size_t n)
+{
+	answer(s, n);
+	if (fflush(stdout) == EOF)
+		err(1, "fflush");
+}
+
+void
+answer(const char *s, size_t n)
+{
+	int digits = ddigits, period = dperiod;
+
+	if (n > 0 && s[n - 1] == '\r')
+		n--;
+
+	const char *p = s, *end = s + n;
+	while (p < end && ISSPACE(*p))
+		p++;
+
+	const char *sec = p;
+	while (p < end && !ISSPACE(*p))
+		p++;
+	size_t secn = (size_t)(p - sec);
+
+	/* A URI’s parameters act as defaults for the fields */
+	uri_t u = {
+		.digits = digits,
+		.period = period,
+	};
+	if (secn >= sizeof(URIPREFIX) - 1
+	 && memcmp(sec, URIPREFIX, sizeof(URIPREFIX) - 1) == 0)
+	{
+		int e = uri_parse(&u, sec, secn);
+		if (e != KEYOK) {
+			printf("error: %s\n", fmtstrerror(e));
+			return;
+		}
+		sec = u.sec;
+		secn = u.secn;
+		digits = u.digits;
+		period = u.period;
+	}
+
+	uint64_t now = (uint64_t)time(NULL);
+
+	while (p < end) {
+		while (p < end && ISSPACE(*p))
+			p++;
+		if (p == end)
+			break;
+
+		const char *f = p;
+		while (p < end && !ISSPACE(*p))
+			p++;
+		size_t fn = (size_t)(p - f);
+
+		const char *eq = memchr(f, '=', fn);
+		if (eq == NULL) {
+			printf("error: %.*s: missing value\n", (int)fn, f);
+			return;
+		}
+
+		uint64_t v;
+		size_t kn = (size_t)(eq - f);
+		if (!getnum(eq + 1, fn - kn - 1, &v)) {
+			printf("error: %.*s: invalid integer\n", (int)fn, f);
+			return;
+		}
+
+		if (kn == 6 && memcmp(f, "digits", 6) == 0) {
+			if (v == 0 || v > 9) {
+				printf("error: %.*s: digits out of range\n", (int)fn, f);
+				return;
+			}
+			digits = (int)v;
+		} else if (kn == 6 && memcmp(f, "period", 6) == 0) {
+			if (v == 0 || v > INT_MAX) {
+				printf("error: %.*s: period out of range\n", (int)fn, f);
+				return;
+			}
+			period = (int)v;
+		} else if (kn == 4 && memcmp(f, "time", 4) == 0)
+			now = v;
+		else {
+			printf("error: %.*s: unknown field\n", (int)kn, f);
+			return;
+		}
+	}
+
+	const hmac_sha1_key_t *key;
+	switch (getkey(&key, sec, secn)) {
+	case KEYEMPTY:
+		puts("error: empty base32 input");
+		return;
+	case KEYINVAL:
+		printf("error: %.*s: invalid base32 input\n", (int)secn, sec);
+		return;
+	}
+
+	uint64_t ctr = u.hotp ? u.counter : now / (uint64_t)period;
+	uint32_t code = hotp(key, ctr) % pow32(10, digits);
+	printf("%0*" PRIu32 "\n", digits, code);
+}
+
+/* Fetch the key for the secret S from the cache, decoding it and
+   replacing whichever secret previously occupied its slot on a miss. */
+int
+getkey(const hmac_sha1_key_t **k, const char *s, size_t n)
+{
+	struct kcent *e = cache + (hash(s, n) & (CACHESZ - 1));
+	*k = &e->key;
+	if (e->valid && e->n == n && memcmp(e->s, s, n) == 0)
+		return KEYOK;
+
+	/* A failed decode may have clobbered the key */
+	int ret = b32key(&e->key, s, n, dlax);
+	if ((e->valid = ret == KEYOK) == false)
+		return ret;
+
+	if (e->cap < n) {
+		e->cap = n;
+		if ((e->s = realloc(e->s, e->cap)) == NULL)
+			err(1, "realloc");
+	}
+	memcpy(e->s, s, n);
+	e->n = n;
+	return KEYOK;
+}
+
+bool
+getnum(const char *s, size_t n, uint64_t *v)
+{
+	if (n == 0 || n > 19)
+		return false;
+	*v = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+		*v = *v * 10 + (uint64_t)(s[i] - '0');
+	}
+	return true;
+}
+
+uint64_t
+hash(const char *s, size_t n)
+{
+	return fnv1a(FNVBASIS, s, n);
+}
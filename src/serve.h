@@ -0,0 +1,8 @@
+#ifndef TOTP_SERVE_H
+#define TOTP_SERVE_H
+
+#include <stdbool.h>
+
+void serve_stdio(int, int, bool);
+
+#endif /* !TOTP_SERVE_H */
@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "base32.h"
+#include "common.h"
+#include "hmac.h"
+#include "sha1.h"
+#include "totp.h"
+#include "xendian.h"
+
+/* Characters of a secret decoded at once by b32key(); a multiple of 8 so
+   that strict decoding never splits a block */
+#define CHUNKSZ (512)
+
+/* Decode the base32 secret S of length N and derive its HMAC key.  If
+   LAX is true S is decoded by b32toalax() rather than b32toa().  Returns
+   KEYOK on success or the reason the secret was rejected.
+
+   Nothing is allocated, so any number of threads may call this at once.
+   A key longer than a block is replaced by its hash (RFC 2104), so no
+   more than a block of it is ever kept: S is decoded a chunk at a time
+   on the stack, and once the key outgrows the block it is streamed into
+   SHA-1 instead. */
+int
+b32key(hmac_sha1_key_t *k, const char *s, size_t n, bool lax)
+{
+	/* Remove padding bytes */
+	if (!lax) {
+		while (n > 0 && s[n - 1] == '=')
+			n--;
+	}
+	if (n == 0)
+		return KEYEMPTY;
+
+	uint8_t blk[SHA1BLKSZ] = {0}, buf[CHUNKSZ / 8 * 5 + 1];
+	size_t keysz = 0;
+	b32lax_t st = {0};
+	sha1_t sha;
+
+	for (size_t i = 0, m; i < n; i += m) {
+		size_t got;
+		m = n - i < CHUNKSZ ? n - i : CHUNKSZ;
+		if (lax) {
+			if (b32toalax(buf, s + i, m, &got, &st) != m)
+				return KEYINVAL;
+		} else {
+			if (b32toa(buf, s + i, m) != m)
+				return KEYINVAL;
+			got = m * 5 / 8;
+		}
+
+		if (keysz + got <= sizeof(blk))
+			memcpy(blk + keysz, buf, got);
+		else {
+			if (keysz <= sizeof(blk)) {
+				sha1init(&sha);
+				sha1hash(&sha, blk, keysz);
+			}
+			sha1hash(&sha, buf, got);
+		}
+		keysz += got;
+	}
+
+	if (lax && keysz == 0)
+		return KEYEMPTY;
+	if (keysz > sizeof(blk)) {
+		memset(blk, 0, sizeof(blk));
+		sha1end(&sha, blk);
+	}
+	hmac_sha1keyblk(k, blk);
+	return KEYOK;
+}
+
+/* Compute the HOTP value for the given counter as described in RFC 4226
+   section 5.3.  The result is the 31-bit dynamically truncated value;
+   reduce it modulo pow32(10, digits) to get the final code. */
+uint32_t
+hotp(const hmac_sha1_key_t *key, uint64_t ctr)
+{
+	uint8_t dgst[SHA1DGSTSZ];
+	ctr = htobe64(ctr);
+	hmac_sha1mid(dgst, key, (uint8_t *)&ctr, sizeof(ctr));
+
+	int off = dgst[19] & 0x0F;
+	return (dgst[off + 0] & 0x7F) << 24
+	     | (dgst[off + 1] & 0xFF) << 16
+	     | (dgst[off + 2] & 0xFF) <<  8
+	     | (dgst[off + 3] & 0xFF) <<  0;
+}
+
+/* TODO: Check for overflow? */
+uint32_t
+pow32(uint32_t x, uint32_t y)
+{
+	uint32_t n = x;
+	if (y == 0)
+		return 1;
+	while (--y != 0)
+		x *= n;
+	return x;
+}
@@ -0,0 +1,26 @@
+#ifndef TOTP_TOTP_H
+#define TOTP_TOTP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hmac.h"
+
+typedef struct {
+	hmac_sha1_key_t key;
+	int digits, period;
+} account_t;
+
+enum {
+	KEYOK,
+	KEYEMPTY,
+	KEYINVAL,
+};
+
+int b32key(hmac_sha1_key_t *, const char *, size_t, bool);
+uint32_t hotp(const hmac_sha1_key_t *, uint64_t);
+uint32_t pow32(uint32_t, uint32_t)
+	__attribute__((const));
+
+#endif /* !TOTP_TOTP_H */
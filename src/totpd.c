@@ -0,0 +1,529 @@
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "input.h"
+#include "keytab.h"
+#include "totp.h"
+
+/* Size of each client’s input and output buffers.  A request must fit
+   in the input buffer, and once the output buffer can’t take another
+   response the client isn’t read from until it has drained. */
+#define BUFSZ   (1024)
+/* Longest possible response */
+#define RESPMAX (64)
+/* Events handled per epoll_wait() */
+#define NEVENTS (64)
+/* Most fields in a request */
+#define NFIELDS (5)
+/* Largest verification window, which bounds the HMACs a request costs */
+#define WINMAX  (10)
+
+#define ISSPACE(c) ((c) == ' ' || (c) == '\t')
+
+struct client {
+	int fd;
+	bool writing;
+	size_t inn, outn;
+	struct client *prev, *next;
+	char in[BUFSZ], out[BUFSZ];
+};
+
+/* Each worker thread owns an epoll instance and the clients it accepted */
+struct worker {
+	int ep;
+	struct client *head;
+};
+
+static void *work(void *);
+static void accepts(struct worker *);
+static void service(struct worker *, struct client *, bool);
+static bool process(struct client *);
+static bool flush(struct client *);
+static void drop(struct worker *, struct client *);
+static size_t answer(char *, const char *, size_t, uint64_t);
+static bool findacct(const char *, size_t, size_t *);
+static bool getnum(const char *, size_t, uint64_t *);
+static int listenon(const char *);
+static void loadkeys(const char *, const char *);
+static void rlimit(void);
+
+static const char *argv0;
+static int lfd, window = 1;
+static keytab_t tab;
+
+static noreturn void
+usage(void)
+{
+	fprintf(stderr,
+	        "Usage: %s [-j jobs] [-S file] [-w window] keytab socket\n"
+	        "       %s -h\n",
+	        argv0, argv0);
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	int opt, jobs = 0;
+	char *Sflag = NULL;
+	static const struct option longopts[] = {
+		{"help",       no_argument,       0, 'h'},
+		{"jobs",       required_argument, 0, 'j'},
+		{"passphrase", required_argument, 0, 'S'},
+		{"window",     required_argument, 0, 'w'},
+		{0},
+	};
+
+	argv0 = basename(argv[0]);
+	while ((opt = getopt_long(argc, argv, "hj:S:w:", longopts, NULL)) != -1) {
+		switch (opt) {
+		case 'h':
+			execlp("man", "man", "8", argv0, NULL);
+			err(1, "execlp: man");
+		case 'S':
+			Sflag = optarg;
+			break;
+		case 'j':
+		case 'w': {
+			uint64_t n;
+			if (!getnum(optarg, strlen(optarg), &n) || n > INT_MAX)
+				errx(1, "%s: invalid integer", optarg);
+			if (opt == 'j' && n == 0)
+				errx(1, "%s: integer must be non-zero", optarg);
+			if (opt == 'w' && n > WINMAX)
+				errx(1, "%s: window must be at most %d", optarg, WINMAX);
+			if (opt == 'j')
+				jobs = (int)n;
+			else
+				window = (int)n;
+			break;
+		}
+		default:
+			usage();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+
+	loadkeys(argv[0], Sflag);
+	rlimit();
+	lfd = listenon(argv[1]);
+
+	/* Termination signals are taken synchronously by this thread alone,
+	   so that the socket is always removed on the way out */
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGHUP);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	if ((errno = pthread_sigmask(SIG_BLOCK, &set, NULL)) != 0)
+		err(1, "pthread_sigmask");
+
+	if (jobs == 0)
+		jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs <= 0)
+		jobs = 1;
+
+	struct worker *ws = calloc((size_t)jobs, sizeof(*ws));
+	if (ws == NULL)
+		err(1, "calloc");
+	for (int i = 0; i < jobs; i++) {
+		/* With EPOLLEXCLUSIVE a new connection wakes only one of the
+		   workers blocked on the listening socket */
+		struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE};
+		if ((ws[i].ep = epoll_create1(EPOLL_CLOEXEC)) == -1)
+			err(1, "epoll_create1");
+		if (epoll_ctl(ws[i].ep, EPOLL_CTL_ADD, lfd, &ev) == -1)
+			err(1, "epoll_ctl");
+
+		pthread_t thrd;
+		if ((errno = pthread_create(&thrd, NULL, work, ws + i)) != 0)
+			err(1, "pthread_create");
+	}
+
+	int sig;
+	if ((errno = sigwait(&set, &sig)) != 0)
+		err(1, "sigwait");
+	if (unlink(argv[1]) == -1)
+		err(1, "unlink: %s", argv[1]);
+	return EXIT_SUCCESS;
+}
+
+/* Open the key table at PATH, unsealing it with the passphrase in the
+   file at PASS if it is sealed */
+void
+loadkeys(const char *path, const char *pass)
+{
+	keytab_open(&tab, path);
+	if (!tab.sealed)
+		return;
+	if (pass == NULL)
+		errx(1, "%s: key table is sealed; give its passphrase with -S", path);
+
+	input_buf_t b;
+	int fd = open(pass, O_RDONLY);
+	if (fd == -1)
+		err(1, "open: %s", pass);
+	input_load(&b, fd);
+	close(fd);
+
+	size_t n = b.n;
+	if (n > 0 && b.p[n - 1] == '\n')
+		n--;
+	if (n == 0)
+		errx(1, "%s: empty passphrase", pass);
+	bool ok = keytab_unseal(&tab, (uint8_t *)b.p, n);
+	if (!b.mapped)
+		memset(b.p, 0, b.n);
+	input_release(&b);
+	if (!ok)
+		errx(1, "%s: wrong passphrase or damaged key table", path);
+}
+
+/* Every client holds a descriptor, so allow as many as we may */
+void
+rlimit(void)
+{
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		(void)setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+/* Listen on a non-blocking Unix domain socket at PATH.  A socket left
+   behind by a daemon that is no longer running is replaced, but one that
+   still accepts connections is an error. */
+int
+listenon(const char *path)
+{
+	struct sockaddr_un sun = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(sun.sun_path))
+		errx(1, "%s: socket path too long", path);
+	strcpy(sun.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		err(1, "socket");
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+		if (errno != EADDRINUSE)
+			err(1, "bind: %s", path);
+
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (probe == -1)
+			err(1, "socket");
+		if (connect(probe, (struct sockaddr *)&sun, sizeof(sun)) == 0)
+			errx(1, "%s: already in use", path);
+		if (errno != ECONNREFUSED)
+			err(1, "connect: %s", path);
+		close(probe);
+
+		if (unlink(path) == -1)
+			err(1, "unlink: %s", path);
+		if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+			err(1, "bind: %s", path);
+	}
+	if (listen(fd, SOMAXCONN) == -1)
+		err(1, "listen: %s", path);
+	return fd;
+}
+
+void *
+work(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event evs[NEVENTS];
+
+	for (;;) {
+		int n = epoll_wait(w->ep, evs, NEVENTS, -1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			err(1, "epoll_wait");
+		}
+		for (int i = 0; i < n; i++) {
+			struct client *c = evs[i].data.ptr;
+			if (c == NULL)
+				accepts(w);
+			else if (evs[i].events & (EPOLLERR | EPOLLHUP)
+			      && !(evs[i].events & EPOLLIN))
+			{
+				drop(w, c);
+			} else
+				service(w, c, !c->writing);
+		}
+	}
+	return NULL;
+}
+
+/* Accept every pending connection */
+void
+accepts(struct worker *w)
+{
+	for (;;) {
+		int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			/* Out of descriptors or memory: the connections wait in
+			   the backlog until a client leaves */
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EMFILE
+			 || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+			{
+				return;
+			}
+			err(1, "accept4");
+		}
+
+		struct client *c = malloc(sizeof(*c));
+		if (c == NULL) {
+			close(fd);
+			return;
+		}
+		c->fd = fd;
+		c->writing = false;
+		c->inn = c->outn = 0;
+
+		struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+		if (epoll_ctl(w->ep, EPOLL_CTL_ADD, fd, &ev) == -1) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		c->prev = NULL;
+		if ((c->next = w->head) != NULL)
+			c->next->prev = c;
+		w->head = c;
+	}
+}
+
+/* Read from C if READABLE is true, then answer as many of its requests as
+   its output buffer allows.  A client whose responses can’t all be sent
+   at once is watched for writability instead of readability until they
+   have been. */
+void
+service(struct worker *w, struct client *c, bool readable)
+{
+	if (readable) {
+		ssize_t m = read(c->fd, c->in + c->inn, sizeof(c->in) - c->inn);
+		if (m == 0 || (m == -1 && errno != EAGAIN && errno != EINTR)) {
+			drop(w, c);
+			return;
+		}
+		if (m > 0)
+			c->inn += (size_t)m;
+	}
+
+	bool more;
+	do {
+		more = process(c);
+		if (!flush(c)) {
+			drop(w, c);
+			return;
+		}
+		/* A request that can never fit */
+		if (c->inn == sizeof(c->in) && memchr(c->in, '\n', c->inn) == NULL) {
+			drop(w, c);
+			return;
+		}
+	} while (more && c->outn == 0);
+
+	bool writing = c->outn != 0;
+	if (writing != c->writing) {
+		struct epoll_event ev = {
+			.events = writing ? EPOLLOUT : EPOLLIN,
+			.data.ptr = c,
+		};
+		if (epoll_ctl(w->ep, EPOLL_CTL_MOD, c->fd, &ev) == -1) {
+			drop(w, c);
+			return;
+		}
+		c->writing = writing;
+	}
+}
+
+/* Answer the complete requests buffered for C.  Returns true if some
+   were left for want of room for their responses. */
+bool
+process(struct client *c)
+{
+	uint64_t now = (uint64_t)time(NULL);
+	char *p = c->in, *end = c->in + c->inn, *nl;
+
+	while ((nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+		if (sizeof(c->out) - c->outn < RESPMAX)
+			break;
+		c->outn += answer(c->out + c->outn, p, (size_t)(nl - p), now);
+		p = nl + 1;
+	}
+
+	c->inn = (size_t)(end - p);
+	memmove(c->in, p, c->inn);
+	return nl != NULL;
+}
+
+/* Send what we can of C’s responses.  Returns false if C is gone. */
+bool
+flush(struct client *c)
+{
+	size_t off = 0;
+	while (off < c->outn) {
+		ssize_t m = send(c->fd, c->out + off, c->outn - off, MSG_NOSIGNAL);
+		if (m == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return false;
+		}
+		off += (size_t)m;
+	}
+	c->outn -= off;
+	memmove(c->out, c->out + off, c->outn);
+	return true;
+}
+
+void
+drop(struct worker *w, struct client *c)
+{
+	close(c->fd);
+	if (c->prev != NULL)
+		c->prev->next = c->next;
+	else
+		w->head = c->next;
+	if (c->next != NULL)
+		c->next->prev = c->prev;
+	free(c);
+}
+
+/* Write the response to the request S of length N, made at time NOW, to
+   DST and return its length.  A request is one of
+
+       gen ACCOUNT [time=N]
+       verify ACCOUNT CODE [time=N]
+
+   and is answered with the code, with ‘ok’ or ‘fail’, or with a line
+   beginning with ‘error: ’.  A verified code may be up to -w periods
+   away from the current one. */
+size_t
+answer(char *dst, const char *s, size_t n, uint64_t now)
+{
+	const char *f[NFIELDS];
+	size_t fn[NFIELDS], nf = 0;
+
+	if (n > 0 && s[n - 1] == '\r')
+		n--;
+	for (const char *p = s, *end = s + n;;) {
+		while (p < end && ISSPACE(*p))
+			p++;
+		if (p == end)
+			break;
+		if (nf == NFIELDS)
+			return (size_t)sprintf(dst, "error: too many fields\n");
+		f[nf] = p;
+		while (p < end && !ISSPACE(*p))
+			p++;
+		fn[nf] = (size_t)(p - f[nf]);
+		nf++;
+	}
+
+	bool verify;
+	if (nf > 0 && fn[0] == 3 && memcmp(f[0], "gen", 3) == 0)
+		verify = false;
+	else if (nf > 0 && fn[0] == 6 && memcmp(f[0], "verify", 6) == 0)
+		verify = true;
+	else
+		return (size_t)sprintf(dst, "error: unknown request\n");
+
+	size_t nargs = verify ? 3 : 2;
+	if (nf < nargs)
+		return (size_t)sprintf(dst, "error: missing argument\n");
+	for (size_t i = nargs; i < nf; i++) {
+		if (fn[i] < 5 || memcmp(f[i], "time=", 5) != 0)
+			return (size_t)sprintf(dst, "error: unknown field\n");
+		if (!getnum(f[i] + 5, fn[i] - 5, &now))
+			return (size_t)sprintf(dst, "error: invalid time\n");
+	}
+
+	size_t rec;
+	account_t a;
+	if (!findacct(f[1], fn[1], &rec))
+		return (size_t)sprintf(dst, "error: no such account\n");
+	if (!keytab_acct(&tab, rec, &a))
+		return (size_t)sprintf(dst, "error: unusable record\n");
+
+	uint32_t mod = pow32(10, (uint32_t)a.digits);
+	uint64_t step = now / (uint64_t)a.period;
+	size_t ret;
+
+	if (!verify) {
+		ret = (size_t)sprintf(dst, "%0*" PRIu32 "\n", a.digits,
+		                      hotp(&a.key, step) % mod);
+	} else {
+		uint64_t code;
+		bool ok = false;
+		if (fn[2] == (size_t)a.digits && getnum(f[2], fn[2], &code)) {
+			/* There are no steps before the epoch to go back to */
+			int back = step < (uint64_t)window ? (int)step : window;
+			uint64_t first = step - (uint64_t)back;
+			for (int i = 0; !ok && i <= back + window; i++)
+				ok = hotp(&a.key, first + (uint64_t)i) % mod == code;
+		}
+		ret = (size_t)sprintf(dst, ok ? "ok\n" : "fail\n");
+	}
+
+	explicit_bzero(&a, sizeof(a));
+	return ret;
+}
+
+/* Find the record of ACCOUNT of length N: its label if the table has an
+   index, or its 1-based record number otherwise */
+bool
+findacct(const char *s, size_t n, size_t *rec)
+{
+	if (tab.nparts != 0)
+		return keytab_find(&tab, s, n, rec);
+
+	uint64_t x;
+	if (!getnum(s, n, &x) || x == 0 || x > tab.nrecs)
+		return false;
+	*rec = (size_t)x - 1;
+	return true;
+}
+
+bool
+getnum(const char *s, size_t n, uint64_t *v)
+{
+	if (n == 0 || n > 19)
+		return false;
+	*v = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+		*v = *v * 10 + (uint64_t)(s[i] - '0');
+	}
+	return true;
+}
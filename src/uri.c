@@ -0,0 +1,199 @@
+#include <limits.h>
+#include <string.h>
+
+#include "common.h"
+#include "fmt.h"
+#include "uri.h"
+
+static bool getnum(const char *, size_t, uint64_t, uint64_t *);
+static bool eqfold(const char *, size_t, const char *);
+
+/* Parse the otpauth:// URI S of length N into U.  The URI is scanned in
+   place and nothing is copied or allocated.  U->digits and U->period are
+   left untouched if the URI doesn’t specify them, so the caller should
+   set them to their defaults beforehand.  Returns KEYOK or the reason
+   the URI was rejected. */
+int
+uri_parse(uri_t *u, const char *s, size_t n)
+{
+	const char *end = s + n;
+
+	if (n < sizeof(URIPREFIX) - 1 || !eqfold(s, sizeof(URIPREFIX) - 1, URIPREFIX))
+		return RECURI;
+	s += sizeof(URIPREFIX) - 1;
+
+	if (end - s < 5 || s[4] != '/')
+		return RECURI;
+	if (eqfold(s, 4, "totp"))
+		u->hotp = false;
+	else if (eqfold(s, 4, "hotp"))
+		u->hotp = true;
+	else
+		return RECURI;
+	s += 5;
+
+	/* The fragment isn’t part of the query */
+	const char *p = memchr(s, '#', (size_t)(end - s));
+	if (p != NULL)
+		end = p;
+
+	const char *q = memchr(s, '?', (size_t)(end - s));
+	if (q == NULL)
+		q = end;
+
+	/* The label is ‘issuer:account’ where the colon may be encoded */
+	u->issuer = NULL;
+	u->issuern = 0;
+	u->label = s;
+	u->labeln = (size_t)(q - s);
+	for (p = s; p < q; p++) {
+		size_t skip = *p == ':' ? 1
+		            : q - p >= 3 && *p == '%' && eqfold(p, 3, "%3a") ? 3
+		            : 0;
+		if (skip != 0) {
+			u->issuer = s;
+			u->issuern = (size_t)(p - s);
+			u->label = p + skip;
+			u->labeln = (size_t)(q - u->label);
+			break;
+		}
+	}
+
+	bool havectr = false;
+	u->sec = NULL;
+	u->secn = 0;
+	for (p = q; p < end; p = q) {
+		p++;
+		if ((q = memchr(p, '&', (size_t)(end - p))) == NULL)
+			q = end;
+
+		const char *v = memchr(p, '=', (size_t)(q - p));
+		if (v == NULL)
+			continue;
+		size_t kn = (size_t)(v - p), vn = (size_t)(q - ++v);
+		uint64_t x;
+
+		if (kn == 6 && memcmp(p, "secret", 6) == 0) {
+			/* Padding is the only thing a base32 secret could need
+			   escaping for, and it’s ignored anyways */
+			while (vn >= 3 && eqfold(v + vn - 3, 3, "%3d"))
+				vn -= 3;
+			u->sec = v;
+			u->secn = vn;
+		} else if (kn == 6 && memcmp(p, "digits", 6) == 0) {
+			if (!getnum(v, vn, 9, &x) || x == 0)
+				return RECDIGITS;
+			u->digits = (int)x;
+		} else if (kn == 6 && memcmp(p, "period", 6) == 0) {
+			if (!getnum(v, vn, INT_MAX, &x) || x == 0)
+				return RECPERIOD;
+			u->period = (int)x;
+		} else if (kn == 6 && memcmp(p, "issuer", 6) == 0) {
+			u->issuer = v;
+			u->issuern = vn;
+		} else if (kn == 7 && memcmp(p, "counter", 7) == 0) {
+			if (!getnum(v, vn, UINT64_MAX, &x))
+				return RECURI;
+			u->counter = x;
+			havectr = true;
+		} else if (kn == 9 && memcmp(p, "algorithm", 9) == 0) {
+			/* SHA-1 is the only HMAC we implement */
+			if (vn != 4 || !eqfold(v, 4, "sha1"))
+				return RECALGO;
+		}
+	}
+
+	if (u->sec == NULL)
+		return RECNOSEC;
+	if (u->hotp && !havectr)
+		return RECURI;
+	return KEYOK;
+}
+
+/* Percent-decode the N bytes at S into DST, which must have room for N
+   bytes, and return the decoded length.  Invalid escapes are copied
+   through as-is. */
+size_t
+uri_unescape(char *dst, const char *s, size_t n)
+{
+	char *d = dst;
+	for (size_t i = 0; i < n; i++) {
+		int hi, lo;
+		if (s[i] == '%' && n - i >= 3 && (hi = uri_unhex(s[i + 1])) != -1
+		    && (lo = uri_unhex(s[i + 2])) != -1)
+		{
+			*d++ = (char)(hi << 4 | lo);
+			i += 2;
+		} else
+			*d++ = s[i];
+	}
+	return (size_t)(d - dst);
+}
+
+/* Percent-encode the N bytes at S into DST, which must have room for
+   3 * N bytes, and return the encoded length.  Everything but the
+   unreserved characters of RFC 3986 is escaped, so the result is safe
+   in both the label and the query. */
+size_t
+uri_escape(char *dst, const char *s, size_t n)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	char *d = dst;
+	for (size_t i = 0; i < n; i++) {
+		unsigned char c = (unsigned char)s[i];
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+		    || (c >= '0' && c <= '9')
+		    || (c != 0 && strchr("-._~", c) != NULL))
+		{
+			*d++ = (char)c;
+		} else {
+			*d++ = '%';
+			*d++ = hex[c >> 4];
+			*d++ = hex[c & 0x0F];
+		}
+	}
+	return (size_t)(d - dst);
+}
+
+/* Parse the decimal integer S of length N into V if it is no more than
+   MAX */
+bool
+getnum(const char *s, size_t n, uint64_t max, uint64_t *v)
+{
+	uint64_t x = 0;
+	if (n == 0)
+		return false;
+	for (size_t i = 0; i < n; i++) {
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+		uint64_t d = (uint64_t)(s[i] - '0');
+		if (x > (max - d) / 10)
+			return false;
+		x = x * 10 + d;
+	}
+	*v = x;
+	return true;
+}
+
+/* Compare the N bytes at S to the lowercase string T ignoring case */
+bool
+eqfold(const char *s, size_t n, const char *t)
+{
+	for (size_t i = 0; i < n; i++) {
+		char c = s[i];
+		if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != t[i])
+			return false;
+	}
+	return true;
+}
+
+/* The value of the hexadecimal digit C, or -1 if it isn’t one */
+int
+uri_unhex(char c)
+{
+	return c >= '0' && c <= '9' ? c - '0'
+	     : c >= 'a' && c <= 'f' ? c - 'a' + 10
+	     : c >= 'A' && c <= 'F' ? c - 'A' + 10
+	     : -1;
+}
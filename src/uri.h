@@ -0,0 +1,29 @@
+#ifndef TOTP_URI_H
+#define TOTP_URI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+/* The parts of an otpauth:// URI as described by the Key Uri Format.
+   All strings point into the URI and are still percent-encoded, except
+   for SEC which never needs decoding. */
+typedef struct {
+	const char *sec, *label, *issuer;
+	size_t secn, labeln, issuern;
+	int digits, period;
+	bool hotp;
+	uint64_t counter;
+} uri_t;
+
+#define URIPREFIX "otpauth://"
+
+int uri_parse(uri_t *, const char *, size_t);
+size_t uri_escape(char *, const char *, size_t);
+size_t uri_unescape(char *, const char *, size_t);
+int uri_unhex(char)
+	__attribute__((const));
+
+#endif /* !TOTP_URI_H */
@@ -0,0 +1,184 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "base32.h"
+#include "common.h"
+#include "fmt.h"
+#include "import.h"
+#include "json.h"
+
+/* Buffers for the parts of an entry that need unescaping */
+struct bufs {
+	char name[IMPSTRMAX], issuer[IMPSTRMAX];
+};
+
+static int entries(json_t *, imfn_t *, void *);
+static int entry(json_t *, imacct_t *, struct bufs *);
+static const char *getstr(const jsontok_t *, char *, size_t, size_t *);
+static bool getnum(const jsontok_t *, uint64_t, uint64_t *);
+
+/* Read the plaintext Aegis export S of length N, calling FN on each of
+   its entries in turn.  The export is an object whose db.entries member
+   is the array of entries; in encrypted exports db is a string. */
+int
+import_aegis(const char *s, size_t n, imfn_t *fn, void *arg)
+{
+	json_t j = {s, s + n};
+	jsontok_t k, v;
+
+	if (json_next(&j, &k) != JSONOBJ)
+		return RECVAULT;
+
+	while (json_next(&j, &k) == JSONSTR) {
+		json_next(&j, &v);
+		if (!json_eq(&k, "db")) {
+			if (!json_skip(&j, &v))
+				return RECVAULT;
+			continue;
+		}
+
+		if (v.type == JSONSTR)
+			return RECCRYPT;
+		if (v.type != JSONOBJ)
+			return RECVAULT;
+
+		while (json_next(&j, &k) == JSONSTR) {
+			json_next(&j, &v);
+			if (json_eq(&k, "entries") && v.type == JSONARR) {
+				int e = entries(&j, fn, arg);
+				if (e != KEYOK)
+					return e;
+			} else if (!json_skip(&j, &v))
+				return RECVAULT;
+		}
+		if (k.type != JSONOBJEND)
+			return RECVAULT;
+	}
+
+	return k.type == JSONOBJEND ? KEYOK : RECVAULT;
+}
+
+/* Read the andOTP export S of length N, which is a bare array of
+   entries, calling FN on each of them in turn */
+int
+import_andotp(const char *s, size_t n, imfn_t *fn, void *arg)
+{
+	json_t j = {s, s + n};
+	jsontok_t t;
+
+	if (json_next(&j, &t) != JSONARR)
+		return RECVAULT;
+	return entries(&j, fn, arg);
+}
+
+/* Read the rest of an array of entries, calling FN on each.  Entries are
+   built from the document in place; only strings with escapes in them
+   are copied, and then into buffers on the stack. */
+int
+entries(json_t *j, imfn_t *fn, void *arg)
+{
+	jsontok_t t;
+	while (json_next(j, &t) == JSONOBJ) {
+		struct bufs b;
+		imacct_t a = {0};
+		if (entry(j, &a, &b) != KEYOK)
+			return RECVAULT;
+		if (a.err == KEYOK && a.sec == NULL)
+			a.err = RECNOSEC;
+		fn(&a, arg);
+	}
+	return t.type == JSONARREND ? KEYOK : RECVAULT;
+}
+
+/* Read the members of an entry object into A.  Aegis keeps the OTP
+   parameters in a nested info object, which is read the same way;
+   andOTP calls the name the label and the algorithm algorithm. */
+int
+entry(json_t *j, imacct_t *a, struct bufs *b)
+{
+	jsontok_t k, v;
+
+	while (json_next(j, &k) == JSONSTR) {
+		uint64_t x;
+
+		json_next(j, &v);
+		if (json_eq(&k, "info") && v.type == JSONOBJ) {
+			if (entry(j, a, b) != KEYOK)
+				return RECVAULT;
+		} else if (json_eq(&k, "secret") && v.type == JSONSTR) {
+			/* Base32 never needs escaping, and like Google exports
+			   we don’t keep keys longer than IMPKEYMAX */
+			a->sec = v.s;
+			a->secn = v.n;
+			if ((v.esc || v.n > B32LEN(IMPKEYMAX)) && a->err == KEYOK)
+				a->err = KEYINVAL;
+		} else if ((json_eq(&k, "name") || json_eq(&k, "label"))
+		      && v.type == JSONSTR)
+		{
+			a->name = getstr(&v, b->name, sizeof(b->name), &a->namen);
+		} else if (json_eq(&k, "issuer") && v.type == JSONSTR)
+			a->issuer = getstr(&v, b->issuer, sizeof(b->issuer), &a->issuern);
+		else if (json_eq(&k, "type") && v.type == JSONSTR) {
+			if (json_eq(&v, "hotp"))
+				a->hotp = true;
+			else if (!json_eq(&v, "totp") && a->err == KEYOK)
+				a->err = RECTYPE;
+		} else if ((json_eq(&k, "algo") || json_eq(&k, "algorithm"))
+		        && v.type == JSONSTR)
+		{
+			/* SHA-1 is the only HMAC we implement */
+			if (!json_eq(&v, "sha1") && a->err == KEYOK)
+				a->err = RECALGO;
+		} else if (json_eq(&k, "digits") && v.type == JSONNUM) {
+			if (getnum(&v, 9, &x) && x != 0)
+				a->digits = (int)x;
+			else if (a->err == KEYOK)
+				a->err = RECDIGITS;
+		} else if (json_eq(&k, "period") && v.type == JSONNUM) {
+			if (getnum(&v, INT_MAX, &x) && x != 0)
+				a->period = (int)x;
+			else if (a->err == KEYOK)
+				a->err = RECPERIOD;
+		} else if (json_eq(&k, "counter") && v.type == JSONNUM) {
+			if (getnum(&v, UINT64_MAX, &x))
+				a->counter = x;
+			else if (a->err == KEYOK)
+				a->err = RECVAULT;
+		} else if (!json_skip(j, &v))
+			return RECVAULT;
+	}
+
+	return k.type == JSONOBJEND ? KEYOK : RECVAULT;
+}
+
+/* Return the contents of the string token T and store its length in N.
+   Strings without escapes are returned in place; others are unescaped
+   into the buffer BUF of size CAP.  Either way at most CAP bytes are
+   kept. */
+const char *
+getstr(const jsontok_t *t, char *buf, size_t cap, size_t *n)
+{
+	if (t->esc) {
+		*n = json_unescape(buf, cap, t->s, t->n);
+		return buf;
+	}
+	*n = t->n < cap ? t->n : cap;
+	return t->s;
+}
+
+bool
+getnum(const jsontok_t *t, uint64_t max, uint64_t *v)
+{
+	*v = 0;
+	for (size_t i = 0; i < t->n; i++) {
+		if (t->s[i] < '0' || t->s[i] > '9')
+			return false;
+		uint64_t d = (uint64_t)(t->s[i] - '0');
+		if (*v > (max - d) / 10)
+			return false;
+		*v = *v * 10 + d;
+	}
+	return true;
+}
@@ -0,0 +1,142 @@
+#if __linux__
+#	include <sys/timerfd.h>
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "acctab.h"
+#include "common.h"
+#include "totp.h"
+#include "watch.h"
+#include "wheel.h"
+
+struct watch {
+	const acctab_t *tab;
+	uint32_t *codes;
+	uint64_t now;
+	wheel_t w;
+};
+
+static void reset(struct watch *);
+static void roll(uint32_t, void *);
+static void sleepuntil(uint64_t);
+static uint64_t xtime(void);
+
+/* Print the codes of all accounts of TAB every time one of them
+   changes, forever.  Each snapshot is a line per account, prefixed by its
+   label and a tab if LABELLED is true, followed by an empty line.
+   Accounts sit in a timer wheel keyed on the end of their current
+   period, so each wakeup only recomputes the accounts that rolled over.
+   If REMAINING is true, every line also includes the number of seconds
+   its code remains valid and a snapshot is printed every second. */
+void
+watch(const acctab_t *tab, bool labelled, bool remaining)
+{
+	size_t n = tab->n;
+	struct watch ctx = {
+		.tab = tab,
+		.now = xtime(),
+	};
+
+	if ((ctx.codes = malloc((n ? n : 1) * sizeof(*ctx.codes))) == NULL)
+		err(1, "malloc");
+	wheel_init(&ctx.w, n, ctx.now);
+	reset(&ctx);
+
+	for (;;) {
+		for (size_t i = 0; i < n; i++) {
+			const char *l = acctab_label(tab, i);
+			if (labelled && l != NULL)
+				printf("%s\t", l);
+			printf("%0*" PRIu32, (int)tab->digits[i], ctx.codes[i]);
+			if (remaining)
+				printf("\t%" PRIu64, ctx.w.expiry[i] - ctx.now);
+			putchar('\n');
+		}
+		putchar('\n');
+		if (fflush(stdout) == EOF)
+			err(1, "fflush");
+
+		sleepuntil(remaining ? ctx.now + 1 : wheel_next(&ctx.w));
+
+		uint64_t now = xtime();
+		if (now < ctx.now) {
+			/* The clock went backwards; start over */
+			ctx.now = now;
+			reset(&ctx);
+		} else {
+			ctx.now = now;
+			wheel_advance(&ctx.w, now, roll, &ctx);
+		}
+	}
+}
+
+void
+reset(struct watch *ctx)
+{
+	wheel_free(&ctx->w);
+	wheel_init(&ctx->w, ctx->tab->n, ctx->now);
+	for (size_t i = 0; i < ctx->tab->n; i++)
+		roll((uint32_t)i, ctx);
+}
+
+void
+roll(uint32_t i, void *arg)
+{
+	struct watch *ctx = arg;
+	const acctab_t *t = ctx->tab;
+	uint64_t step = ctx->now / t->periods[i];
+
+	ctx->codes[i] = hotp(t->keys + i, step) % pow32(10, t->digits[i]);
+	wheel_add(&ctx->w, i, (step + 1) * t->periods[i]);
+}
+
+void
+sleepuntil(uint64_t t)
+{
+#if __linux__
+	static int fd = -1;
+	if (fd == -1 && (fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC)) == -1)
+		err(1, "timerfd_create");
+
+	/* Wake up early if the clock is changed so that a jump doesn’t
+	   leave us asleep with stale codes */
+	struct itimerspec its = {.it_value.tv_sec = (time_t)t};
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+	                    &its, NULL) == -1)
+	{
+		err(1, "timerfd_settime");
+	}
+
+	uint64_t n;
+	if (read(fd, &n, sizeof(n)) == -1 && errno != ECANCELED && errno != EINTR)
+		err(1, "read");
+#else
+	uint64_t now = xtime();
+	if (now >= t)
+		return;
+	struct timespec ts = {.tv_sec = (time_t)(t - now)};
+	while (nanosleep(&ts, &ts) == -1) {
+		if (errno != EINTR)
+			err(1, "nanosleep");
+	}
+#endif
+}
+
+/* time(2) may be backed by a coarse clock that lags behind the one the
+   timer fires on, which would have us wake up a tick before the period
+   boundary and go straight back to sleep.  Read the precise clock. */
+uint64_t
+xtime(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts) == -1)
+		err(1, "clock_gettime");
+	return (uint64_t)ts.tv_sec;
+}
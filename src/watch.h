@@ -0,0 +1,12 @@
+#ifndef TOTP_WATCH_H
+#define TOTP_WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdnoreturn.h>
+
+#include "acctab.h"
+
+noreturn void watch(const acctab_t *, bool, bool);
+
+#endif /* !TOTP_WATCH_H */
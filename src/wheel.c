@@ -0,0 +1,88 @@
+#include <err.h>
+#include <stdlib.h>
+
+#include "wheel.h"
+
+void
+wheel_init(wheel_t *w, size_t n, uint64_t now)
+{
+	for (size_t i = 0; i < WHEELSZ; i++)
+		w->heads[i] = WHEELNIL;
+	w->next = malloc((n ? n : 1) * sizeof(*w->next));
+	w->expiry = malloc((n ? n : 1) * sizeof(*w->expiry));
+	if (w->next == NULL || w->expiry == NULL)
+		err(1, "malloc");
+	w->now = now;
+}
+
+void
+wheel_free(wheel_t *w)
+{
+	free(w->next);
+	free(w->expiry);
+}
+
+/* Schedule entry I to fire at time EXPIRY, which must lie after the
+   wheel’s current time. */
+void
+wheel_add(wheel_t *w, uint32_t i, uint64_t expiry)
+{
+	uint32_t *h = w->heads + expiry % WHEELSZ;
+	w->expiry[i] = expiry;
+	w->next[i] = *h;
+	*h = i;
+}
+
+/* Advance the wheel to time NOW, calling FN on every entry that expired
+   along the way.  FN may reschedule the entry it is given. */
+void
+wheel_advance(wheel_t *w, uint64_t now, void (*fn)(uint32_t, void *),
+              void *arg)
+{
+	if (now <= w->now)
+		return;
+
+	/* Past one full revolution every slot has been visited */
+	uint64_t t = now - w->now > WHEELSZ ? now - WHEELSZ : w->now;
+
+	while (t++ < now) {
+		uint32_t *p = w->heads + t % WHEELSZ, fired = WHEELNIL;
+
+		/* Unlink everything due first so that FN can safely
+		   reschedule into the slot we are walking */
+		while (*p != WHEELNIL) {
+			uint32_t i = *p;
+			if (w->expiry[i] <= now) {
+				*p = w->next[i];
+				w->next[i] = fired;
+				fired = i;
+			} else
+				p = w->next + i;
+		}
+
+		w->now = t;
+		while (fired != WHEELNIL) {
+			uint32_t i = fired;
+			fired = w->next[i];
+			fn(i, arg);
+		}
+	}
+	w->now = now;
+}
+
+/* Return the earliest expiry in the wheel, or 0 if the wheel is empty.
+   Slots are visited in time order so this usually stops early. */
+uint64_t
+wheel_next(const wheel_t *w)
+{
+	uint64_t min = 0;
+	for (uint64_t t = w->now + 1; t <= w->now + WHEELSZ; t++) {
+		for (uint32_t i = w->heads[t % WHEELSZ]; i != WHEELNIL; i = w->next[i]) {
+			if (w->expiry[i] == t)
+				return t;
+			if (min == 0 || w->expiry[i] < min)
+				min = w->expiry[i];
+		}
+	}
+	return min;
+}
@@ -0,0 +1,28 @@
+#ifndef TOTP_WHEEL_H
+#define TOTP_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A hashed timer wheel with a resolution of one second.  Entries are
+   identified by their index and chained through NEXT, so the wheel does
+   no allocation after wheel_init().  Expiries further away than WHEELSZ
+   seconds simply survive extra revolutions of the wheel. */
+
+#define WHEELSZ (64)
+#define WHEELNIL UINT32_MAX
+
+typedef struct {
+	uint32_t heads[WHEELSZ];
+	uint32_t *next;
+	uint64_t *expiry;
+	uint64_t now;
+} wheel_t;
+
+void wheel_init(wheel_t *, size_t, uint64_t);
+void wheel_free(wheel_t *);
+void wheel_add(wheel_t *, uint32_t, uint64_t);
+void wheel_advance(wheel_t *, uint64_t, void (*)(uint32_t, void *), void *);
+uint64_t wheel_next(const wheel_t *);
+
+#endif /* !TOTP_WHEEL_H */
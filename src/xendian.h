@@ -14,6 +14,11 @@
 #	include <arpa/inet.h>
 #	define htobe32(x) htonl(x)
 #	define htobe64(x) htonll(x)
+/* All Apple platforms are little-endian */
+#	define htole32(x) (x)
+#	define htole64(x) (x)
+#	define le32toh(x) (x)
+#	define le64toh(x) (x)
 #else
 #	include <sys/endian.h>
 #endif